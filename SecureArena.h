@@ -0,0 +1,282 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// Allocators used by SecuredPtr for its protected buffer.
+// An allocator is a class with only static members:
+//   Allocate(size)        - returns a buffer aligned to the cipher block size or nullptr
+//   Deallocate(ptr, size) - wipes and releases a buffer returned by Allocate(size)
+
+#include "SecureCryptBackend.h"
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Secured_Ptr
+{
+    //Plain CRT heap, the buffer is wiped before it is released
+    class MallocSecureAllocator
+    {
+    public:
+        static PBYTE Allocate(size_t size)
+        {
+            return (PBYTE)malloc(size);
+        }
+
+        static void Deallocate(PBYTE ptr, size_t size)
+        {
+            if (ptr == nullptr)
+                return;
+            SecureZeroMemory(ptr, size);
+            free(ptr);
+        }
+    };
+
+#ifdef _WIN32
+    typedef MallocSecureAllocator DefaultSecureAllocator;
+#else
+    struct SecureArenaStats
+    {
+        size_t bytesRequested;  //Bytes asked for by live allocations
+        size_t bytesInUse;      //Slot bytes handed out to live allocations
+        size_t bytesMapped;     //Bytes mapped for slots, guard pages excluded
+        size_t bytesLocked;     //Part of bytesMapped that could be mlock'd
+        size_t allocations;     //Live allocations
+
+        //Share of the mapped secure memory that does not hold requested data
+        double Fragmentation() const
+        {
+            return bytesMapped == 0 ? 0.0 : 1.0 - (double)bytesRequested / (double)bytesMapped;
+        }
+    };
+
+    //Size class arena of locked pages for secrets.
+    //Every class carves fixed size slots out of runs of pages. A run is bracketed by PROT_NONE guard pages,
+    //mlock'd and marked MADV_DONTDUMP so that secrets are neither swapped out nor written to core dumps.
+    //Slots are aligned to their size (a multiple of the cipher block size) and are wiped when freed.
+    //Requests above the largest class get their own guarded mapping.
+    class SecureArena
+    {
+    public:
+        static constexpr size_t MinSlotSize = 32;
+        static constexpr size_t MaxSlotSize = 4096;
+        static constexpr size_t ClassCount = 8; //32, 64, ... 4096
+        static constexpr size_t MinRunSize = 16 * 1024;
+
+        static SecureArena& Instance()
+        {
+            static SecureArena arena;
+            return arena;
+        }
+
+        PBYTE Allocate(size_t size)
+        {
+            if (size == 0)
+                return nullptr;
+            if (size > MaxSlotSize)
+                return AllocateLarge(size);
+
+            size_t cls = GetClass(size);
+            SizeClass& sc = classes[cls];
+            PBYTE slot;
+            {
+                std::lock_guard<std::mutex> lg(sc.m);
+                if (sc.freeList == nullptr && !AddRun(cls))
+                    return nullptr;
+                slot = (PBYTE)sc.freeList;
+                sc.freeList = sc.freeList->next;
+            }
+            ((FreeSlot*)slot)->next = nullptr;
+            bytesRequested.fetch_add(size, std::memory_order_relaxed);
+            bytesInUse.fetch_add(GetSlotSize(cls), std::memory_order_relaxed);
+            allocations.fetch_add(1, std::memory_order_relaxed);
+            return slot;
+        }
+
+        void Deallocate(PBYTE ptr, size_t size)
+        {
+            if (ptr == nullptr || size == 0)
+                return;
+            if (size > MaxSlotSize)
+            {
+                DeallocateLarge(ptr, size);
+                return;
+            }
+
+            size_t cls = GetClass(size);
+            SizeClass& sc = classes[cls];
+            SecureZeroMemory(ptr, GetSlotSize(cls));
+            bytesRequested.fetch_sub(size, std::memory_order_relaxed);
+            bytesInUse.fetch_sub(GetSlotSize(cls), std::memory_order_relaxed);
+            allocations.fetch_sub(1, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lg(sc.m);
+            FreeSlot* slot = (FreeSlot*)ptr;
+            slot->next = sc.freeList;
+            sc.freeList = slot;
+        }
+
+        SecureArenaStats GetStats() const
+        {
+            SecureArenaStats stats;
+            stats.bytesRequested = bytesRequested.load(std::memory_order_relaxed);
+            stats.bytesInUse = bytesInUse.load(std::memory_order_relaxed);
+            stats.bytesMapped = bytesMapped.load(std::memory_order_relaxed);
+            stats.bytesLocked = bytesLocked.load(std::memory_order_relaxed);
+            stats.allocations = allocations.load(std::memory_order_relaxed);
+            return stats;
+        }
+
+    private:
+        struct FreeSlot
+        {
+            FreeSlot* next;
+        };
+
+        //Sits in front of a large allocation, keeps it aligned to the cipher block size
+        struct alignas(16) LargeHeader
+        {
+            size_t mapped;
+            bool locked;
+        };
+
+        struct SizeClass
+        {
+            std::mutex m;
+            FreeSlot* freeList = nullptr;
+        };
+
+        SizeClass classes[ClassCount];
+        size_t pageSize;
+        std::atomic<size_t> bytesRequested{ 0 };
+        std::atomic<size_t> bytesInUse{ 0 };
+        std::atomic<size_t> bytesMapped{ 0 };
+        std::atomic<size_t> bytesLocked{ 0 };
+        std::atomic<size_t> allocations{ 0 };
+
+        SecureArena() : pageSize((size_t)sysconf(_SC_PAGESIZE)) {}
+        SecureArena(const SecureArena&) = delete;
+        SecureArena& operator=(const SecureArena&) = delete;
+
+        static size_t GetClass(size_t size)
+        {
+            size_t cls = 0;
+            while ((MinSlotSize << cls) < size)
+                cls++;
+            return cls;
+        }
+
+        static size_t GetSlotSize(size_t cls)
+        {
+            return MinSlotSize << cls;
+        }
+
+        size_t RoundToPages(size_t size) const
+        {
+            return (size + pageSize - 1) / pageSize * pageSize;
+        }
+
+        //Maps size bytes between two guard pages and returns the usable part
+        PBYTE MapGuarded(size_t size, bool* locked = nullptr)
+        {
+            PBYTE base = (PBYTE)mmap(nullptr, size + 2 * pageSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base == (PBYTE)MAP_FAILED)
+                return nullptr;
+            mprotect(base, pageSize, PROT_NONE);
+            mprotect(base + pageSize + size, pageSize, PROT_NONE);
+            PBYTE data = base + pageSize;
+            madvise(data, size, MADV_DONTDUMP);
+            //Best effort, a run that cannot be locked is still usable
+            bool isLocked = mlock(data, size) == 0;
+            if (isLocked)
+                bytesLocked.fetch_add(size, std::memory_order_relaxed);
+            if (locked != nullptr)
+                *locked = isLocked;
+            bytesMapped.fetch_add(size, std::memory_order_relaxed);
+            return data;
+        }
+
+        //Must be called with the class mutex held
+        bool AddRun(size_t cls)
+        {
+            size_t slotSize = GetSlotSize(cls);
+            size_t runSize = RoundToPages(slotSize * 8 > MinRunSize ? slotSize * 8 : MinRunSize);
+            PBYTE run = MapGuarded(runSize);
+            if (run == nullptr)
+                return false;
+            for (size_t offset = runSize; offset >= slotSize; offset -= slotSize)
+            {
+                FreeSlot* slot = (FreeSlot*)(run + offset - slotSize);
+                slot->next = classes[cls].freeList;
+                classes[cls].freeList = slot;
+            }
+            return true;
+        }
+
+        PBYTE AllocateLarge(size_t size)
+        {
+            size_t mapped = RoundToPages(size + sizeof(LargeHeader));
+            bool locked = false;
+            PBYTE data = MapGuarded(mapped, &locked);
+            if (data == nullptr)
+                return nullptr;
+            LargeHeader* header = (LargeHeader*)data;
+            header->mapped = mapped;
+            header->locked = locked;
+            bytesRequested.fetch_add(size, std::memory_order_relaxed);
+            bytesInUse.fetch_add(mapped, std::memory_order_relaxed);
+            allocations.fetch_add(1, std::memory_order_relaxed);
+            return data + sizeof(LargeHeader);
+        }
+
+        void DeallocateLarge(PBYTE ptr, size_t size)
+        {
+            PBYTE data = ptr - sizeof(LargeHeader);
+            LargeHeader* header = (LargeHeader*)data;
+            size_t mapped = header->mapped;
+            if (header->locked)
+                bytesLocked.fetch_sub(mapped, std::memory_order_relaxed);
+            SecureZeroMemory(data, mapped);
+            munmap(data - pageSize, mapped + 2 * pageSize);
+            bytesRequested.fetch_sub(size, std::memory_order_relaxed);
+            bytesInUse.fetch_sub(mapped, std::memory_order_relaxed);
+            bytesMapped.fetch_sub(mapped, std::memory_order_relaxed);
+            allocations.fetch_sub(1, std::memory_order_relaxed);
+        }
+    };
+
+    //SecuredPtr allocator on top of the process wide SecureArena
+    class SecureArenaAllocator
+    {
+    public:
+        static PBYTE Allocate(size_t size)
+        {
+            return SecureArena::Instance().Allocate(size);
+        }
+
+        static void Deallocate(PBYTE ptr, size_t size)
+        {
+            SecureArena::Instance().Deallocate(ptr, size);
+        }
+
+        static SecureArenaStats GetStats()
+        {
+            return SecureArena::Instance().GetStats();
+        }
+    };
+
+    typedef SecureArenaAllocator DefaultSecureAllocator;
+#endif
+}
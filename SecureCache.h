@@ -0,0 +1,275 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// Process wide cache of decrypted copies of the most used SecuredPtr values, read by operator*.
+// Disabled till SetBudget() gives it a byte budget. The copies live in buffers of the secure allocator
+// (locked, excluded from core dumps) and are wiped when evicted, the budget caps their total size.
+// The cache is split in shards by SecuredPtr address, each with its own lock, a CLOCK ring for eviction
+// and a small frequency sketch: a new value only replaces one that was used less often (TinyLFU).
+// Entries carry the version of their SecuredPtr, any assignment or change in place makes them stale.
+
+#include "SecureArena.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Secured_Ptr
+{
+    struct SecureCacheStats
+    {
+        size_t budget;      //Bytes of plaintext the cache may hold
+        size_t bytesCached; //Bytes of plaintext it holds
+        size_t entries;
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t rejected;    //Values not admitted: too big or used less than what they would evict
+    };
+
+    class SecurePlainCache
+    {
+    public:
+        static SecurePlainCache& Instance()
+        {
+            static SecurePlainCache cache;
+            return cache;
+        }
+
+        //Byte budget of the cached plaintext, 0 (the default) disables the cache and wipes it
+        static void SetBudget(size_t bytes)
+        {
+            SecurePlainCache& cache = Instance();
+            cache.budget.store(bytes, std::memory_order_relaxed);
+            for (Shard& shard : cache.shards)
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                while (!shard.entries.empty() && shard.bytes > bytes / ShardCount)
+                    Remove(shard, shard.hand < shard.entries.size() ? shard.hand : 0, true);
+            }
+        }
+
+        static bool Enabled()
+        {
+            return Alive().load(std::memory_order_relaxed) && Instance().budget.load(std::memory_order_relaxed) > 0;
+        }
+
+        //Wipes every cached value
+        static void Clear()
+        {
+            for (Shard& shard : Instance().shards)
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                while (!shard.entries.empty())
+                    Remove(shard, shard.entries.size() - 1, false);
+            }
+        }
+
+        static SecureCacheStats GetStats()
+        {
+            SecurePlainCache& cache = Instance();
+            SecureCacheStats stats = {};
+            stats.budget = cache.budget.load(std::memory_order_relaxed);
+            for (Shard& shard : cache.shards)
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                stats.bytesCached += shard.bytes;
+                stats.entries += shard.entries.size();
+                stats.hits += shard.hits;
+                stats.misses += shard.misses;
+                stats.evictions += shard.evictions;
+                stats.rejected += shard.rejected;
+            }
+            return stats;
+        }
+
+        //Calls read(data, size) with the cached value of owner at version under the lock of its shard.
+        //False on a miss, the owner is then a candidate for Insert().
+        template <typename Reader>
+        bool Lookup(const void* owner, uint64_t version, Reader&& read)
+        {
+            Shard& shard = GetShard(owner);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Touch(shard, owner);
+            auto it = shard.index.find(owner);
+            if (it != shard.index.end())
+            {
+                Entry& entry = shard.entries[it->second];
+                if (entry.version == version)
+                {
+                    entry.referenced = true;
+                    shard.hits++;
+                    read(static_cast<const BYTE*>(entry.data), entry.size);
+                    return true;
+                }
+                Remove(shard, it->second, false);
+            }
+            shard.misses++;
+            return false;
+        }
+
+        //Caches a copy of the size bytes of data for owner when its version is still current
+        bool Insert(const void* owner, uint64_t version, const BYTE* data, size_t size, const std::atomic<uint64_t>& currentVersion)
+        {
+            size_t shardBudget = budget.load(std::memory_order_relaxed) / ShardCount;
+            Shard& shard = GetShard(owner);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (currentVersion.load() != version)
+                return false;
+            auto it = shard.index.find(owner);
+            if (it != shard.index.end())
+                Remove(shard, it->second, false);
+            if (size == 0 || size > shardBudget)
+            {
+                shard.rejected++;
+                return false;
+            }
+
+            //CLOCK: referenced entries get a second chance, the first other one is the victim
+            while (shard.bytes + size > shardBudget)
+            {
+                if (shard.hand >= shard.entries.size())
+                    shard.hand = 0;
+                Entry& victim = shard.entries[shard.hand];
+                if (victim.referenced)
+                {
+                    victim.referenced = false;
+                    shard.hand++;
+                    continue;
+                }
+                if (Frequency(shard, owner) <= Frequency(shard, victim.owner))
+                {
+                    shard.rejected++;
+                    return false;
+                }
+                Remove(shard, shard.hand, true);
+            }
+
+            PBYTE copy = DefaultSecureAllocator::Allocate(size);
+            if (copy == nullptr)
+                return false;
+            memcpy(copy, data, size);
+            shard.index[owner] = shard.entries.size();
+            shard.entries.push_back(Entry{ owner, version, copy, size, false });
+            shard.bytes += size;
+            return true;
+        }
+
+        //Drops the cached value of owner
+        void Invalidate(const void* owner)
+        {
+            if (!Alive().load(std::memory_order_relaxed))
+                return;
+            Shard& shard = GetShard(owner);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.index.find(owner);
+            if (it != shard.index.end())
+                Remove(shard, it->second, false);
+        }
+
+        ~SecurePlainCache()
+        {
+            Clear();
+            Alive().store(false, std::memory_order_relaxed);
+        }
+
+    private:
+        static constexpr size_t ShardCount = 16;
+        static constexpr size_t SketchSize = 1024;
+        static constexpr BYTE SketchMax = 15;
+
+        struct Entry
+        {
+            const void* owner;
+            uint64_t version;
+            PBYTE data;
+            size_t size;
+            bool referenced; //Read since the CLOCK hand last passed
+        };
+
+        struct alignas(64) Shard
+        {
+            std::mutex mutex;
+            std::vector<Entry> entries; //CLOCK ring
+            std::unordered_map<const void*, size_t> index;
+            size_t hand = 0;
+            size_t bytes = 0;
+            BYTE sketch[SketchSize] = {}; //Recent lookups per owner hash, halved every SketchSize * 8 lookups
+            size_t lookups = 0;
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t evictions = 0;
+            size_t rejected = 0;
+        };
+
+        std::atomic<size_t> budget{ 0 };
+        Shard shards[ShardCount];
+
+        SecurePlainCache() {}
+        SecurePlainCache(const SecurePlainCache&) = delete;
+        SecurePlainCache& operator=(const SecurePlainCache&) = delete;
+
+        //SecuredPtr objects destroyed after the cache (static ones) must not use it, a trivially destructible
+        //flag outlives it
+        static std::atomic<bool>& Alive()
+        {
+            static std::atomic<bool> alive{ true };
+            return alive;
+        }
+
+        static size_t Hash(const void* owner)
+        {
+            uint64_t h = (uint64_t)(uintptr_t)owner * 0x9E3779B97F4A7C15ULL;
+            return (size_t)(h >> 32);
+        }
+
+        Shard& GetShard(const void* owner)
+        {
+            return shards[Hash(owner) % ShardCount];
+        }
+
+        static BYTE Frequency(Shard& shard, const void* owner)
+        {
+            return shard.sketch[(Hash(owner) >> 4) % SketchSize];
+        }
+
+        static void Touch(Shard& shard, const void* owner)
+        {
+            BYTE& count = shard.sketch[(Hash(owner) >> 4) % SketchSize];
+            if (count < SketchMax)
+                count++;
+            if (++shard.lookups >= SketchSize * 8)
+            {
+                //Aging, old popularity fades out
+                for (BYTE& c : shard.sketch)
+                    c >>= 1;
+                shard.lookups = 0;
+            }
+        }
+
+        //Wipes and frees the entry at i, the last entry takes its place in the ring
+        static void Remove(Shard& shard, size_t i, bool evicted)
+        {
+            Entry& entry = shard.entries[i];
+            shard.index.erase(entry.owner);
+            shard.bytes -= entry.size;
+            DefaultSecureAllocator::Deallocate(entry.data, entry.size);
+            if (i + 1 != shard.entries.size())
+            {
+                entry = shard.entries.back();
+                shard.index[entry.owner] = i;
+            }
+            shard.entries.pop_back();
+            if (evicted)
+                shard.evictions++;
+        }
+    };
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// Constant time comparison of two buffers used by the SecuredPtr comparison operators.
+// Every byte is always read, the differences are OR-ed together and only the final result is tested,
+// so the time depends on the length alone and not on where the buffers differ.
+// The kernel is chosen once at runtime: AVX2 or SSE2 on x86-64, NEON on ARM, a portable loop otherwise.
+
+#include "SecureCryptBackend.h"
+
+//SSE2 is part of x86-64 so only AVX2 needs a runtime check
+#if defined(__x86_64__) || defined(_M_X64)
+#define SECURE_COMPARE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64)
+#define SECURE_COMPARE_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(SECURE_COMPARE_X86) && !defined(_MSC_VER)
+#define SECURE_TARGET_AVX2 __attribute__((target("avx2")))
+#define SECURE_TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#define SECURE_TARGET_AVX2
+#define SECURE_TARGET_SSE2
+#endif
+
+namespace Secured_Ptr
+{
+    class SecureCompare
+    {
+    public:
+        //True when the len bytes of a and b are equal, in constant time for a given len
+        static bool Equal(const void* a, const void* b, size_t len)
+        {
+            return GetKernel().diff(static_cast<const BYTE*>(a), static_cast<const BYTE*>(b), len) == 0;
+        }
+
+        //Name of the kernel selected for this CPU
+        static const char* KernelName()
+        {
+            return GetKernel().name;
+        }
+
+    private:
+        struct Kernel
+        {
+            BYTE(*diff)(const BYTE*, const BYTE*, size_t);
+            const char* name;
+        };
+
+        static const Kernel& GetKernel()
+        {
+            static const Kernel kernel = SelectKernel();
+            return kernel;
+        }
+
+        static Kernel SelectKernel()
+        {
+#ifdef SECURE_COMPARE_X86
+            if (HasAvx2())
+                return Kernel{ &DiffAvx2, "avx2" };
+            return Kernel{ &DiffSse2, "sse2" };
+#elif defined(SECURE_COMPARE_NEON)
+            return Kernel{ &DiffNeon, "neon" };
+#else
+            return Kernel{ &DiffScalar, "scalar" };
+#endif
+        }
+
+        //OR of the differences of the remaining bytes, also the portable kernel
+        static BYTE DiffScalar(const BYTE* a, const BYTE* b, size_t len)
+        {
+            volatile BYTE diff = 0;
+            for (size_t i = 0; i < len; i++)
+                diff |= a[i] ^ b[i];
+            return diff;
+        }
+
+#ifdef SECURE_COMPARE_X86
+        static bool HasAvx2()
+        {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 1);
+            //AVX state must be enabled by the OS (OSXSAVE, AVX and XCR0 bits 1-2)
+            if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+                return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2") != 0;
+#endif
+        }
+
+        SECURE_TARGET_SSE2 static BYTE Fold(__m128i acc)
+        {
+            alignas(16) BYTE lanes[16];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), acc);
+            BYTE diff = 0;
+            for (size_t i = 0; i < sizeof(lanes); i++)
+                diff |= lanes[i];
+            return diff;
+        }
+
+        SECURE_TARGET_SSE2 static BYTE DiffSse2(const BYTE* a, const BYTE* b, size_t len)
+        {
+            __m128i acc = _mm_setzero_si128();
+            size_t i = 0;
+            for (; i + 16 <= len; i += 16)
+                acc = _mm_or_si128(acc, _mm_xor_si128(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+            return Fold(acc) | DiffScalar(a + i, b + i, len - i);
+        }
+
+        SECURE_TARGET_AVX2 static BYTE DiffAvx2(const BYTE* a, const BYTE* b, size_t len)
+        {
+            __m256i acc = _mm256_setzero_si256();
+            size_t i = 0;
+            for (; i + 32 <= len; i += 32)
+                acc = _mm256_or_si256(acc, _mm256_xor_si256(
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i))));
+            __m128i half = _mm_or_si128(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            if (i + 16 <= len)
+            {
+                half = _mm_or_si128(half, _mm_xor_si128(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))));
+                i += 16;
+            }
+            return Fold(half) | DiffScalar(a + i, b + i, len - i);
+        }
+#endif
+
+#ifdef SECURE_COMPARE_NEON
+        static BYTE DiffNeon(const BYTE* a, const BYTE* b, size_t len)
+        {
+            uint8x16_t acc = vdupq_n_u8(0);
+            size_t i = 0;
+            for (; i + 16 <= len; i += 16)
+                acc = vorrq_u8(acc, veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+            BYTE lanes[16];
+            vst1q_u8(lanes, acc);
+            BYTE diff = 0;
+            for (size_t k = 0; k < sizeof(lanes); k++)
+                diff |= lanes[k];
+            return diff | DiffScalar(a + i, b + i, len - i);
+        }
+#endif
+    };
+}
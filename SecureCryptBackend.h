@@ -0,0 +1,670 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// Crypto backends used by SecuredPtr to protect/unprotect its buffer in place.
+// A backend is a class with only static members:
+//   BlockSize                     - granularity the data is padded to
+//   GetBlockSize(dataSize)        - bytes to allocate for dataSize bytes of data, constexpr so that
+//                                   SecuredPtr can size its inline storage
+//   Protect(data, dataBlockSize)  - encrypt the buffer in place
+//   Unprotect(data, dataBlockSize)- decrypt the buffer in place
+// The encrypted buffer must not depend on its address so that it can be copied as is.
+// A backend whose keystream can be addressed by offset also declares Seekable = true and provides:
+//   Nonce                                   - type of the per-buffer nonce
+//   TrailerSize                             - bytes at the end of the buffer that are not data (the nonce)
+//   NewNonce(nonce)                         - a fresh nonce
+//   GetNonce(data, dataBlockSize)           - nonce of a protected buffer
+//   SetNonce(data, dataBlockSize, nonce)    - stores the nonce of a buffer encrypted piece by piece
+//   CryptRange(nonce, offset, chunk, len)   - encrypts or decrypts len bytes found at offset of the data,
+//                                             chunk may be anywhere (a bounce buffer) and offset any byte
+// SecuredPtr then streams and reads or writes ranges without decrypting the whole buffer.
+// A backend whose key can be replaced also declares Rotatable = true and provides:
+//   RotateKey()                             - a new key encrypts from now on, the previous one still decrypts
+//                                             (kept as is while a previous rotation is not retired)
+//   RetireKey()                             - wipes the previous key once nothing is encrypted under it anymore
+//   IsCurrentKey(data, dataBlockSize)       - whether a protected buffer is encrypted under the current key
+//   PinKey() / UnpinKey(generation)         - keeps the current key from being retired meanwhile
+// SecureRegistry::Rekey() rotates it and re-encrypts every registered SecuredPtr.
+// A backend that processes several buffers faster together declares Batch = true and provides
+//   ProtectMany(data, dataBlockSizes, count, results) and UnprotectMany(...), results[i] telling whether
+//   data[i] was processed. CryptMany() falls back to one call per buffer for the other backends.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#ifdef _WIN32
+#include "Windows.h"
+#include "Wincrypt.h"
+#pragma comment(lib, "crypt32.lib")
+#else
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <unistd.h>
+#endif
+
+namespace Secured_Ptr
+{
+#ifndef _WIN32
+    typedef unsigned char BYTE;
+    typedef BYTE* PBYTE;
+
+    inline void SecureZeroMemory(void* ptr, size_t cnt)
+    {
+#ifdef __linux__
+        explicit_bzero(ptr, cnt);
+#else
+        volatile BYTE* p = static_cast<volatile BYTE*>(ptr);
+        while (cnt--)
+            *p++ = 0;
+#endif
+    }
+#endif
+
+#ifdef _WIN32
+    //Windows DPAPI, the data is protected with the session key of the process
+    class DpapiCryptBackend
+    {
+    public:
+        static constexpr size_t BlockSize = CRYPTPROTECTMEMORY_BLOCK_SIZE;
+
+        static constexpr size_t GetBlockSize(size_t dataSize)
+        {
+            size_t mod = dataSize % BlockSize;
+            //CryptProtectMemory requires data to be a multiple of its block size
+            if (mod != 0)
+                return dataSize + (BlockSize - mod);
+            return dataSize;
+        }
+
+        static bool Protect(PBYTE data, size_t dataBlockSize)
+        {
+            return CryptProtectMemory(data, (DWORD)dataBlockSize, CRYPTPROTECTMEMORY_SAME_PROCESS) != FALSE;
+        }
+
+        static bool Unprotect(PBYTE data, size_t dataBlockSize)
+        {
+            return CryptUnprotectMemory(data, (DWORD)dataBlockSize, CRYPTPROTECTMEMORY_SAME_PROCESS) != FALSE;
+        }
+    };
+
+    typedef DpapiCryptBackend DefaultCryptBackend;
+#else
+    //Userspace ChaCha20 under a random per-process key kept in a locked page excluded from core dumps.
+    //The buffer is padded to BlockSize and followed by a trailer block holding the nonce used for it,
+    //every Protect() takes a fresh nonce so that the keystream is never reused for new data.
+    //The nonce also names the key generation: after RotateKey() the previous key keeps decrypting what
+    //it encrypted till RetireKey() wipes it.
+    //Keystream blocks are computed several at a time, in the vector lanes of the best kernel of the CPU
+    //(AVX-512, AVX2, else SSE2/NEON), whether they belong to one large buffer or to many small ones.
+    class LinuxCryptBackend
+    {
+    public:
+        static constexpr size_t BlockSize = 16;
+        static constexpr size_t TrailerSize = 16;
+
+        static constexpr size_t GetBlockSize(size_t dataSize)
+        {
+            size_t mod = dataSize % BlockSize;
+            if (mod != 0)
+                dataSize += (BlockSize - mod);
+            return dataSize + TrailerSize;
+        }
+
+        static bool Protect(PBYTE data, size_t dataBlockSize)
+        {
+            Nonce nonce;
+            if (data == nullptr || dataBlockSize < TrailerSize || !NewNonce(nonce))
+                return false;
+            SetNonce(data, dataBlockSize, nonce);
+            return CryptRange(nonce, 0, data, dataBlockSize - TrailerSize);
+        }
+
+        static bool Unprotect(PBYTE data, size_t dataBlockSize)
+        {
+            if (data == nullptr || dataBlockSize < TrailerSize)
+                return false;
+            return CryptRange(GetNonce(data, dataBlockSize), 0, data, dataBlockSize - TrailerSize);
+        }
+
+        //ChaCha20 is a counter mode so any range of a buffer can be processed on its own
+        static constexpr bool Seekable = true;
+
+        struct Nonce
+        {
+            uint64_t counter;
+            uint32_t generation; //Key the buffer is encrypted under
+        };
+
+        static bool NewNonce(Nonce& nonce)
+        {
+            ProcessKey* key = GetProcessKey();
+            if (key == nullptr)
+                return false;
+            nonce.counter = key->nonce.fetch_add(1, std::memory_order_relaxed);
+            nonce.generation = key->current.load(std::memory_order_acquire);
+            return true;
+        }
+
+        static Nonce GetNonce(const BYTE* data, size_t dataBlockSize)
+        {
+            Nonce nonce;
+            const BYTE* trailer = data + dataBlockSize - TrailerSize;
+            memcpy(&nonce.counter, trailer, sizeof(nonce.counter));
+            memcpy(&nonce.generation, trailer + sizeof(nonce.counter), sizeof(nonce.generation));
+            return nonce;
+        }
+
+        static void SetNonce(PBYTE data, size_t dataBlockSize, Nonce nonce)
+        {
+            PBYTE trailer = data + dataBlockSize - TrailerSize;
+            memcpy(trailer, &nonce.counter, sizeof(nonce.counter));
+            memcpy(trailer + sizeof(nonce.counter), &nonce.generation, sizeof(nonce.generation));
+            memset(trailer + sizeof(nonce.counter) + sizeof(nonce.generation), 0,
+                TrailerSize - sizeof(nonce.counter) - sizeof(nonce.generation));
+        }
+
+        //False when the key of the nonce was retired
+        static bool CryptRange(Nonce nonce, size_t offset, PBYTE chunk, size_t len)
+        {
+            ProcessKey* key = GetProcessKey();
+            if (key == nullptr || (chunk == nullptr && len > 0))
+                return false;
+            KeySlot& slot = key->slots[nonce.generation % KeySlots];
+            //RetireKey() waits for the users that found the key in place
+            slot.users.fetch_add(1);
+            bool usable = nonce.generation != 0 && slot.generation.load() == nonce.generation;
+            if (usable)
+                ChaCha20Xor(slot.words, nonce.counter, offset, chunk, len);
+            slot.users.fetch_sub(1, std::memory_order_release);
+            return usable;
+        }
+
+        static constexpr bool Batch = true;
+
+        static bool ProtectMany(PBYTE const* data, const size_t* dataBlockSizes, size_t count, bool* results)
+        {
+            return CryptBuffers(data, dataBlockSizes, count, results, true);
+        }
+
+        static bool UnprotectMany(PBYTE const* data, const size_t* dataBlockSizes, size_t count, bool* results)
+        {
+            return CryptBuffers(data, dataBlockSizes, count, results, false);
+        }
+
+        //Kernel picked for this CPU
+        static const char* KernelName()
+        {
+            return GetKernel().name;
+        }
+
+        static constexpr bool Rotatable = true;
+
+        //Makes a new random key the current one. While the previous key has not been retired the current key
+        //is still new and is kept.
+        static bool RotateKey()
+        {
+            ProcessKey* key = GetProcessKey();
+            if (key == nullptr)
+                return false;
+            std::lock_guard<std::mutex> lock(key->rotation);
+            uint32_t next = key->current.load(std::memory_order_relaxed) + 1;
+            KeySlot& slot = key->slots[next % KeySlots];
+            if (slot.generation.load() != 0)
+                return true;
+            if (getrandom(slot.words, sizeof(slot.words), 0) != (ssize_t)sizeof(slot.words))
+            {
+                SecureZeroMemory(slot.words, sizeof(slot.words));
+                return false;
+            }
+            slot.generation.store(next);
+            key->current.store(next, std::memory_order_release);
+            return true;
+        }
+
+        //Wipes the key used before the last RotateKey(), after the calls still using it are done.
+        //Whatever is still encrypted under it cannot be decrypted anymore.
+        static void RetireKey()
+        {
+            ProcessKey* key = GetProcessKey();
+            if (key == nullptr)
+                return;
+            std::lock_guard<std::mutex> lock(key->rotation);
+            KeySlot& slot = key->slots[(key->current.load(std::memory_order_relaxed) + 1) % KeySlots];
+            if (slot.generation.load() == 0)
+                return;
+            slot.generation.store(0);
+            while (slot.users.load() != 0)
+                std::this_thread::yield();
+            SecureZeroMemory(slot.words, sizeof(slot.words));
+        }
+
+        static bool IsCurrentKey(const BYTE* data, size_t dataBlockSize)
+        {
+            ProcessKey* key = GetProcessKey();
+            return key != nullptr && GetNonce(data, dataBlockSize).generation == key->current.load(std::memory_order_acquire);
+        }
+
+        //Generation of the current key, which cannot be retired till UnpinKey()
+        static uint32_t PinKey()
+        {
+            ProcessKey* key = GetProcessKey();
+            if (key == nullptr)
+                return 0;
+            for (;;)
+            {
+                uint32_t generation = key->current.load(std::memory_order_acquire);
+                KeySlot& slot = key->slots[generation % KeySlots];
+                slot.users.fetch_add(1);
+                if (slot.generation.load() == generation)
+                    return generation;
+                slot.users.fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        static void UnpinKey(uint32_t generation)
+        {
+            ProcessKey* key = GetProcessKey();
+            if (key != nullptr && generation != 0)
+                key->slots[generation % KeySlots].users.fetch_sub(1, std::memory_order_release);
+        }
+
+    private:
+        static constexpr uint32_t KeySlots = 2; //The current key and the one being retired
+
+        struct alignas(64) KeySlot
+        {
+            uint32_t words[8];
+            std::atomic<uint32_t> generation; //0 when the slot holds no key
+            std::atomic<uint32_t> users;      //Crypto calls and pins using the key right now
+        };
+
+        struct ProcessKey
+        {
+            KeySlot slots[KeySlots];
+            std::atomic<uint32_t> current;
+            std::atomic<uint64_t> nonce;
+            std::mutex rotation;
+        };
+
+        static ProcessKey* CreateProcessKey()
+        {
+            size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+            void* page = mmap(nullptr, pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (page == MAP_FAILED)
+                return nullptr;
+            //Best effort, the key still works when the memlock limit is exhausted
+            mlock(page, pageSize);
+            madvise(page, pageSize, MADV_DONTDUMP);
+
+            ProcessKey* key = new (page) ProcessKey();
+            uint64_t nonce = 0;
+            KeySlot& first = key->slots[1];
+            if (getrandom(first.words, sizeof(first.words), 0) != (ssize_t)sizeof(first.words) ||
+                getrandom(&nonce, sizeof(nonce), 0) != (ssize_t)sizeof(nonce))
+            {
+                SecureZeroMemory(page, pageSize);
+                munmap(page, pageSize);
+                return nullptr;
+            }
+            key->nonce.store(nonce, std::memory_order_relaxed);
+            key->slots[0].generation.store(0, std::memory_order_relaxed);
+            key->slots[0].users.store(0, std::memory_order_relaxed);
+            first.generation.store(1, std::memory_order_relaxed);
+            first.users.store(0, std::memory_order_relaxed);
+            key->current.store(1, std::memory_order_release);
+            return key;
+        }
+
+        static ProcessKey* GetProcessKey()
+        {
+            static ProcessKey* key = CreateProcessKey();
+            return key;
+        }
+
+        static inline uint32_t Rotl(uint32_t v, int c)
+        {
+            return (v << c) | (v >> (32 - c));
+        }
+
+        static inline void QuarterRound(uint32_t* x, int a, int b, int c, int d)
+        {
+            x[a] += x[b]; x[d] = Rotl(x[d] ^ x[a], 16);
+            x[c] += x[d]; x[b] = Rotl(x[b] ^ x[c], 12);
+            x[a] += x[b]; x[d] = Rotl(x[d] ^ x[a], 8);
+            x[c] += x[d]; x[b] = Rotl(x[b] ^ x[c], 7);
+        }
+
+        static void ChaCha20Block(const uint32_t* key, uint64_t nonce, uint64_t counter, BYTE* out)
+        {
+            uint32_t input[16] = {
+                0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+                key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+                (uint32_t)counter, (uint32_t)(counter >> 32), (uint32_t)nonce, (uint32_t)(nonce >> 32) };
+            uint32_t x[16];
+            memcpy(x, input, sizeof(x));
+            for (int i = 0; i < 10; i++)
+            {
+                QuarterRound(x, 0, 4, 8, 12);
+                QuarterRound(x, 1, 5, 9, 13);
+                QuarterRound(x, 2, 6, 10, 14);
+                QuarterRound(x, 3, 7, 11, 15);
+                QuarterRound(x, 0, 5, 10, 15);
+                QuarterRound(x, 1, 6, 11, 12);
+                QuarterRound(x, 2, 7, 8, 13);
+                QuarterRound(x, 3, 4, 9, 14);
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                uint32_t v = x[i] + input[i];
+                out[4 * i] = (BYTE)v;
+                out[4 * i + 1] = (BYTE)(v >> 8);
+                out[4 * i + 2] = (BYTE)(v >> 16);
+                out[4 * i + 3] = (BYTE)(v >> 24);
+            }
+            SecureZeroMemory(x, sizeof(x));
+            SecureZeroMemory(input, sizeof(input));
+        }
+
+        //XORs len bytes that sit at offset of the keystream, the first block may be entered in the middle
+        static void ChaCha20Xor(const uint32_t* key, uint64_t nonce, size_t offset, PBYTE data, size_t len)
+        {
+            CryptSpan span = { key, nonce, offset / 64, offset % 64, data, len };
+            CryptSpans(&span, 1);
+        }
+
+        static constexpr size_t MaxLanes = 16;
+        static constexpr size_t BuffersPerPass = 64; //Buffers of CryptBuffers() handled per pin of the keys
+
+        //Computes one 64 byte keystream block per lane. state holds the 16 input words of the lanes and out
+        //the 16 output words, word i of lane l at i * lanes + l.
+        struct Kernel
+        {
+            void (*run)(const uint32_t* state, uint32_t* out);
+            size_t lanes;
+            const char* name;
+        };
+
+        //Data to XOR with the keystream of key and nonce, from byte skip of keystream block counter
+        struct CryptSpan
+        {
+            const uint32_t* key;
+            uint64_t nonce;
+            uint64_t counter;
+            size_t skip;
+            PBYTE data;
+            size_t len;
+        };
+
+        static bool CryptBuffers(PBYTE const* data, const size_t* dataBlockSizes, size_t count, bool* results, bool encrypt)
+        {
+            ProcessKey* key = GetProcessKey();
+            bool all = true;
+            for (size_t first = 0; first < count; first += BuffersPerPass)
+            {
+                size_t n = count - first < BuffersPerPass ? count - first : BuffersPerPass;
+                if (key == nullptr)
+                {
+                    for (size_t i = 0; i < n; i++)
+                        results[first + i] = false;
+                    all = false;
+                    continue;
+                }
+                //Both keys are held, so whatever generation a buffer names cannot be wiped meanwhile
+                for (KeySlot& slot : key->slots)
+                    slot.users.fetch_add(1);
+                uint32_t generation = key->current.load(std::memory_order_acquire);
+                while (key->slots[generation % KeySlots].generation.load() != generation)
+                    generation = key->current.load(std::memory_order_acquire);
+                uint64_t counter = encrypt ? key->nonce.fetch_add(n, std::memory_order_relaxed) : 0;
+                CryptSpan spans[BuffersPerPass];
+                size_t used = 0;
+                for (size_t i = 0; i < n; i++)
+                {
+                    PBYTE buffer = data[first + i];
+                    size_t dataBlockSize = dataBlockSizes[first + i];
+                    bool ok = buffer != nullptr && dataBlockSize >= TrailerSize;
+                    if (ok)
+                    {
+                        Nonce nonce = { counter + i, generation };
+                        if (encrypt)
+                            SetNonce(buffer, dataBlockSize, nonce);
+                        else
+                            nonce = GetNonce(buffer, dataBlockSize);
+                        KeySlot& slot = key->slots[nonce.generation % KeySlots];
+                        ok = nonce.generation != 0 && slot.generation.load() == nonce.generation;
+                        if (ok)
+                            spans[used++] = { slot.words, nonce.counter, 0, 0, buffer, dataBlockSize - TrailerSize };
+                    }
+                    results[first + i] = ok;
+                    all = all && ok;
+                }
+                CryptSpans(spans, used);
+                for (KeySlot& slot : key->slots)
+                    slot.users.fetch_sub(1, std::memory_order_release);
+            }
+            return all;
+        }
+
+        //Deals the keystream blocks of the spans to the lanes of the kernel, a lone block is computed on its own
+        static void CryptSpans(CryptSpan* spans, size_t count)
+        {
+            struct Lane
+            {
+                const CryptSpan* span;
+                uint64_t counter;
+                size_t skip;
+                PBYTE data;
+                size_t len;
+            };
+            const Kernel& kernel = GetKernel();
+            uint32_t state[16 * MaxLanes] = {};
+            uint32_t stream[16 * MaxLanes];
+            BYTE block[64];
+            Lane lanes[MaxLanes];
+            size_t next = 0;
+            for (;;)
+            {
+                size_t n = 0;
+                while (n < kernel.lanes && next < count)
+                {
+                    CryptSpan& span = spans[next];
+                    if (span.len == 0)
+                    {
+                        next++;
+                        continue;
+                    }
+                    size_t take = 64 - span.skip;
+                    if (take > span.len)
+                        take = span.len;
+                    lanes[n] = { &span, span.counter, span.skip, span.data, take };
+                    span.counter++;
+                    span.skip = 0;
+                    span.data += take;
+                    span.len -= take;
+                    n++;
+                }
+                if (n == 0)
+                    break;
+                if (n == 1)
+                {
+                    ChaCha20Block(lanes[0].span->key, lanes[0].span->nonce, lanes[0].counter, block);
+                    for (size_t i = 0; i < lanes[0].len; i++)
+                        lanes[0].data[i] ^= block[lanes[0].skip + i];
+                    continue;
+                }
+                for (size_t l = 0; l < n; l++)
+                    SetLaneState(state, kernel.lanes, l, lanes[l].span->key, lanes[l].span->nonce, lanes[l].counter);
+                kernel.run(state, stream);
+                for (size_t l = 0; l < n; l++)
+                    XorLane(stream + l, kernel.lanes, lanes[l].skip, lanes[l].data, lanes[l].len);
+            }
+            SecureZeroMemory(state, sizeof(state));
+            SecureZeroMemory(stream, sizeof(stream));
+            SecureZeroMemory(block, sizeof(block));
+        }
+
+        //XORs len bytes of the keystream words stream[0], stream[stride]... from byte skip into data
+        static void XorLane(const uint32_t* stream, size_t stride, size_t skip, PBYTE data, size_t len)
+        {
+            size_t k = skip;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            //The keystream is little endian, whole words can be used as they are
+            for (; k % 4 != 0 && len > 0; k++, len--)
+                *data++ ^= (BYTE)(stream[(k / 4) * stride] >> (8 * (k % 4)));
+            for (; len >= 4; k += 4, len -= 4, data += 4)
+            {
+                uint32_t w;
+                memcpy(&w, data, sizeof(w));
+                w ^= stream[(k / 4) * stride];
+                memcpy(data, &w, sizeof(w));
+            }
+#endif
+            for (; len > 0; k++, len--)
+                *data++ ^= (BYTE)(stream[(k / 4) * stride] >> (8 * (k % 4)));
+        }
+
+        static void SetLaneState(uint32_t* state, size_t lanes, size_t lane, const uint32_t* key, uint64_t nonce, uint64_t counter)
+        {
+            const uint32_t words[16] = {
+                0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+                key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+                (uint32_t)counter, (uint32_t)(counter >> 32), (uint32_t)nonce, (uint32_t)(nonce >> 32) };
+            for (size_t i = 0; i < 16; i++)
+                state[i * lanes + lane] = words[i];
+        }
+
+#if defined(__GNUC__) || defined(__clang__)
+        //The compiler maps these on the vector registers of the target, or emulates them
+        typedef uint32_t Lanes4 __attribute__((vector_size(16)));
+        typedef uint32_t Lanes8 __attribute__((vector_size(32)));
+        typedef uint32_t Lanes16 __attribute__((vector_size(64)));
+
+        template <typename V>
+        static inline __attribute__((always_inline)) void QuarterRoundLanes(V* x, int a, int b, int c, int d)
+        {
+            x[a] += x[b]; x[d] ^= x[a]; x[d] = (x[d] << 16) | (x[d] >> 16);
+            x[c] += x[d]; x[b] ^= x[c]; x[b] = (x[b] << 12) | (x[b] >> 20);
+            x[a] += x[b]; x[d] ^= x[a]; x[d] = (x[d] << 8) | (x[d] >> 24);
+            x[c] += x[d]; x[b] ^= x[c]; x[b] = (x[b] << 7) | (x[b] >> 25);
+        }
+
+        //ChaCha20Block() on every lane of V, inlined in each kernel so that it is compiled for its instruction set
+        template <typename V, size_t Lanes>
+        static inline __attribute__((always_inline)) void ChaCha20Lanes(const uint32_t* state, uint32_t* out)
+        {
+            V input[16];
+            V x[16];
+            for (int i = 0; i < 16; i++)
+            {
+                memcpy(&input[i], state + i * Lanes, sizeof(V));
+                x[i] = input[i];
+            }
+            for (int i = 0; i < 10; i++)
+            {
+                QuarterRoundLanes(x, 0, 4, 8, 12);
+                QuarterRoundLanes(x, 1, 5, 9, 13);
+                QuarterRoundLanes(x, 2, 6, 10, 14);
+                QuarterRoundLanes(x, 3, 7, 11, 15);
+                QuarterRoundLanes(x, 0, 5, 10, 15);
+                QuarterRoundLanes(x, 1, 6, 11, 12);
+                QuarterRoundLanes(x, 2, 7, 8, 13);
+                QuarterRoundLanes(x, 3, 4, 9, 14);
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                x[i] += input[i];
+                memcpy(out + i * Lanes, &x[i], sizeof(V));
+            }
+            SecureZeroMemory(x, sizeof(x));
+            SecureZeroMemory(input, sizeof(input));
+        }
+
+        static void ChaCha20Lanes4(const uint32_t* state, uint32_t* out)
+        {
+            ChaCha20Lanes<Lanes4, 4>(state, out);
+        }
+
+#if defined(__x86_64__) || defined(__i386__)
+        __attribute__((target("avx2"))) static void ChaCha20Lanes8(const uint32_t* state, uint32_t* out)
+        {
+            ChaCha20Lanes<Lanes8, 8>(state, out);
+        }
+
+        __attribute__((target("avx512f"))) static void ChaCha20Lanes16(const uint32_t* state, uint32_t* out)
+        {
+            ChaCha20Lanes<Lanes16, 16>(state, out);
+        }
+#endif
+#endif
+
+        static Kernel SelectKernel()
+        {
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f"))
+                return { &ChaCha20Lanes16, 16, "avx512f x16" };
+            if (__builtin_cpu_supports("avx2"))
+                return { &ChaCha20Lanes8, 8, "avx2 x8" };
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+            return { &ChaCha20Lanes4, 4, "vector x4" };
+#else
+            return { nullptr, 1, "scalar" };
+#endif
+        }
+
+        static const Kernel& GetKernel()
+        {
+            static const Kernel kernel = SelectKernel();
+            return kernel;
+        }
+    };
+
+    typedef LinuxCryptBackend DefaultCryptBackend;
+#endif
+
+    //True for backends that declare Seekable = true
+    template <typename Backend, typename = void> struct IsSeekableBackend : std::false_type {};
+    template <typename Backend> struct IsSeekableBackend<Backend, typename std::enable_if<Backend::Seekable>::type> : std::true_type {};
+
+    //True for backends that declare Rotatable = true
+    template <typename Backend, typename = void> struct IsRotatableBackend : std::false_type {};
+    template <typename Backend> struct IsRotatableBackend<Backend, typename std::enable_if<Backend::Rotatable>::type> : std::true_type {};
+
+    //True for backends that declare Batch = true
+    template <typename Backend, typename = void> struct IsBatchBackend : std::false_type {};
+    template <typename Backend> struct IsBatchBackend<Backend, typename std::enable_if<Backend::Batch>::type> : std::true_type {};
+
+    //Protect() or Unprotect() of count buffers, in one call when the backend declares Batch = true.
+    //results[i] tells whether data[i] was processed, the return value whether all were.
+    template <typename Backend>
+    bool CryptMany(PBYTE const* data, const size_t* dataBlockSizes, size_t count, bool* results, bool encrypt)
+    {
+        if constexpr (IsBatchBackend<Backend>::value)
+            return encrypt ? Backend::ProtectMany(data, dataBlockSizes, count, results) :
+                Backend::UnprotectMany(data, dataBlockSizes, count, results);
+        else
+        {
+            bool all = true;
+            for (size_t i = 0; i < count; i++)
+            {
+                results[i] = encrypt ? Backend::Protect(data[i], dataBlockSizes[i]) : Backend::Unprotect(data[i], dataBlockSizes[i]);
+                all = all && results[i];
+            }
+            return all;
+        }
+    }
+}
@@ -0,0 +1,312 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// Opt-in expiry deadlines of SecuredPtr objects, compiled in by defining _SecuredExpiry for the whole program.
+// SetExpiry() links the SecuredPtr in a hierarchical timer wheel: 4 levels of 64 slots with a tick of 10 ms,
+// level n holding the deadlines due within 64^(n+1) ticks (46 hours in all, later ones wait in the last level).
+// Scheduling and cancelling only link or unlink the object in the list of one slot, O(1) whatever the number
+// of deadlines. The wheel thread moves the lists of a slot down one level when the lower level turns around and
+// sleeps till the next tick that can hold a deadline, so an idle wheel costs nothing.
+// When a deadline is due the thread wipes the secret and empties the SecuredPtr, under the lock of the wheel
+// for one batch at a time, so that the destructor of the SecuredPtr waits for it instead of racing it.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace Secured_Ptr
+{
+    //Links of an object in the wheel. With _SecuredExpiry SecuredPtr derives from it.
+    struct SecureExpiryNode
+    {
+        SecureExpiryNode* prev = nullptr;
+        SecureExpiryNode* next = nullptr;
+        uint64_t expires = 0;                     //Tick of the deadline, 0 when none is set
+        uint32_t slot = 0;                        //List the node is in
+        void (*expire)(SecureExpiryNode* node) = nullptr;
+        std::atomic<bool> scheduled{ false };     //Lets Cancel() skip the lock of the wheel, set under it
+    };
+
+#ifdef _SecuredExpiry
+    typedef SecureExpiryNode SecureExpiryHook;
+#else
+    struct SecureExpiryHook {};
+#endif
+
+    class SecureExpiry
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+        typedef void (*ExpireFunction)(SecureExpiryNode* node);
+
+        static constexpr std::chrono::milliseconds Tick{ 10 };
+
+        //Never destroyed so that static SecuredPtr objects can cancel their deadline till exit
+        static SecureExpiry& Instance()
+        {
+            static SecureExpiry* wheel = new SecureExpiry();
+            return *wheel;
+        }
+
+        //Calls expire(node) on the wheel thread once deadline has passed (at most one tick later), replaces the
+        //deadline node had. False when the thread cannot run.
+        bool Schedule(SecureExpiryNode* node, Clock::time_point deadline, ExpireFunction expire)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!StartThread())
+                return false;
+            if (node->expires != 0)
+                Unlink(node);
+            else if (pending++ == 0)
+            {
+                //The thread leaves current behind while the wheel is empty
+                uint64_t now = Now();
+                current = now > current ? now : current;
+            }
+            //Rounded up so that a deadline never fires early
+            auto delay = deadline - epoch;
+            uint64_t tick = delay.count() > 0 ? (uint64_t)((delay + Tick - Clock::duration(1)) / Tick) : 0;
+            node->expires = tick > current ? tick : current + 1;
+            node->expire = expire;
+            node->scheduled.store(true, std::memory_order_relaxed);
+            Insert(node);
+            if (node->expires < wakeTick)
+                wakeup.notify_one();
+            return true;
+        }
+
+        //Removes the deadline of node, waits for an expiry of node in progress
+        void Cancel(SecureExpiryNode* node)
+        {
+            if (!node->scheduled.load(std::memory_order_acquire))
+                return;
+            std::lock_guard<std::mutex> lock(mutex);
+            node->scheduled.store(false, std::memory_order_relaxed);
+            if (node->expires == 0)
+                return;
+            Unlink(node);
+            node->expires = 0;
+            pending--;
+        }
+
+        //Deadline of node rounded up to the tick, time_point::max() when none is set
+        Clock::time_point GetDeadline(const SecureExpiryNode* node)
+        {
+            if (!node->scheduled.load(std::memory_order_acquire))
+                return Clock::time_point::max();
+            std::lock_guard<std::mutex> lock(mutex);
+            return node->expires != 0 ? TimeOf(node->expires) : Clock::time_point::max();
+        }
+
+        //Deadlines waiting
+        static size_t GetPending()
+        {
+            SecureExpiry& wheel = Instance();
+            std::lock_guard<std::mutex> lock(wheel.mutex);
+            return wheel.pending;
+        }
+
+    private:
+        static constexpr uint32_t Bits = 6;
+        static constexpr uint32_t SlotsPerLevel = 1 << Bits;
+        static constexpr uint32_t Levels = 4;
+        static constexpr uint32_t DueSlot = Levels * SlotsPerLevel; //Expiring now, see Run()
+        static constexpr uint64_t Span = (uint64_t)1 << (Bits * Levels);
+        static constexpr size_t ExpireBatch = 64;
+
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::thread worker;
+        SecureExpiryNode heads[DueSlot + 1];
+        uint64_t occupied[Levels] = {}; //Bit i of level n: slot i is not empty
+        uint64_t current = 0;           //Last tick done
+        uint64_t wakeTick = UINT64_MAX; //Tick the thread sleeps till
+        size_t pending = 0;
+        const Clock::time_point epoch = Clock::now();
+
+        SecureExpiry()
+        {
+            for (SecureExpiryNode& head : heads)
+                head.prev = head.next = &head;
+        }
+        SecureExpiry(const SecureExpiry&) = delete;
+        SecureExpiry& operator=(const SecureExpiry&) = delete;
+
+        Clock::time_point TimeOf(uint64_t tick) const
+        {
+            return epoch + std::chrono::duration_cast<Clock::duration>(Tick * tick);
+        }
+
+        uint64_t Now() const
+        {
+            return (uint64_t)((Clock::now() - epoch) / Tick);
+        }
+
+        //Called with the mutex held
+        bool StartThread()
+        {
+            if (worker.joinable())
+                return true;
+            try
+            {
+                worker = std::thread(&SecureExpiry::Run, this);
+            }
+            catch (...)
+            {
+                return false;
+            }
+            return true;
+        }
+
+        void Link(SecureExpiryNode* node, uint32_t slot)
+        {
+            SecureExpiryNode* head = &heads[slot];
+            node->slot = slot;
+            node->prev = head;
+            node->next = head->next;
+            head->next->prev = node;
+            head->next = node;
+            if (slot < DueSlot)
+                occupied[slot / SlotsPerLevel] |= (uint64_t)1 << (slot % SlotsPerLevel);
+        }
+
+        void Unlink(SecureExpiryNode* node)
+        {
+            node->prev->next = node->next;
+            node->next->prev = node->prev;
+            node->prev = nullptr;
+            node->next = nullptr;
+            SecureExpiryNode* head = &heads[node->slot];
+            if (node->slot < DueSlot && head->next == head)
+                occupied[node->slot / SlotsPerLevel] &= ~((uint64_t)1 << (node->slot % SlotsPerLevel));
+        }
+
+        //Links node in the slot reached when its deadline is less than a turn of the next level away.
+        //Deadlines beyond the wheel go in the last level and are placed again each time it turns around.
+        void Insert(SecureExpiryNode* node)
+        {
+            uint64_t at = node->expires - current < Span ? node->expires : current + Span - 1;
+            uint64_t distance = at - current;
+            uint32_t level = 0;
+            while (level + 1 < Levels && distance >= ((uint64_t)1 << (Bits * (level + 1))))
+                level++;
+            Link(node, level * SlotsPerLevel + (uint32_t)((at >> (Bits * level)) & (SlotsPerLevel - 1)));
+        }
+
+        //Unlinks every node of slot and places it again from the current tick
+        void Cascade(uint32_t slot)
+        {
+            SecureExpiryNode* head = &heads[slot];
+            SecureExpiryNode* node = head->next;
+            head->prev = head->next = head;
+            occupied[slot / SlotsPerLevel] &= ~((uint64_t)1 << (slot % SlotsPerLevel));
+            while (node != head)
+            {
+                SecureExpiryNode* next = node->next;
+                Insert(node);
+                node = next;
+            }
+        }
+
+        //Moves to tick: the higher levels whose slot comes around are brought down, then the nodes due at tick
+        //go to the due list
+        void Advance(uint64_t tick)
+        {
+            current = tick;
+            for (uint32_t level = 1; level < Levels; level++)
+            {
+                if ((tick & (((uint64_t)1 << (Bits * level)) - 1)) != 0)
+                    break;
+                Cascade(level * SlotsPerLevel + (uint32_t)((tick >> (Bits * level)) & (SlotsPerLevel - 1)));
+            }
+            uint32_t slot = (uint32_t)(tick & (SlotsPerLevel - 1));
+            SecureExpiryNode* head = &heads[slot];
+            while (head->next != head)
+            {
+                SecureExpiryNode* node = head->next;
+                Unlink(node);
+                Link(node, DueSlot);
+            }
+        }
+
+        //First tick after current that can expire a node or bring nodes down a level
+        uint64_t NextTick() const
+        {
+            uint64_t next = UINT64_MAX;
+            if (occupied[0] != 0)
+            {
+                //Level 0 slots rotated so that bit 0 is the next tick
+                uint32_t shift = (uint32_t)((current + 1) & (SlotsPerLevel - 1));
+                uint64_t rotated = shift == 0 ? occupied[0] : (occupied[0] >> shift) | (occupied[0] << (SlotsPerLevel - shift));
+                uint32_t distance = 0;
+                while (!(rotated & ((uint64_t)1 << distance)))
+                    distance++;
+                next = current + 1 + distance;
+            }
+            for (uint32_t level = 1; level < Levels; level++)
+            {
+                if (occupied[level] != 0)
+                {
+                    uint64_t boundary = ((current >> Bits) + 1) << Bits;
+                    return boundary < next ? boundary : next;
+                }
+            }
+            return next;
+        }
+
+        void Run()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                SecureExpiryNode* due = &heads[DueSlot];
+                if (due->next != due)
+                {
+                    //The owners may cancel the nodes left between two batches
+                    for (size_t n = 0; n < ExpireBatch && due->next != due; n++)
+                    {
+                        SecureExpiryNode* node = due->next;
+                        Unlink(node);
+                        node->expires = 0;
+                        pending--;
+                        node->expire(node);
+                        node->scheduled.store(false, std::memory_order_release);
+                    }
+                    lock.unlock();
+                    lock.lock();
+                    continue;
+                }
+                uint64_t now = Now();
+                if (current < now)
+                {
+                    //Ticks without a deadline due or a level to bring down are skipped
+                    uint64_t next = NextTick();
+                    if (next > now)
+                        current = now;
+                    else
+                        Advance(next);
+                    continue;
+                }
+                if (pending == 0)
+                {
+                    wakeTick = UINT64_MAX;
+                    wakeup.wait(lock, [this] { return pending > 0; });
+                    continue;
+                }
+                wakeTick = NextTick();
+                wakeup.wait_until(lock, TimeOf(wakeTick));
+                wakeTick = UINT64_MAX;
+            }
+        }
+    };
+}
@@ -0,0 +1,718 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// Sealed file of secrets: SecureFileWriter saves many SecuredPtr values in one file encrypted under a 32 byte
+// wrapping key, SecureFile maps the file and hands its entries to SecuredPtr objects that copy them into
+// secure memory only when they are first used. Opening costs the same whatever the number of entries and an
+// entry that is never used is never read from the file.
+//
+// Layout, integers little endian:
+//   header  64 bytes   magic "SPSEALD1", version, entry size, count, index offset, data offset, salt, MAC
+//   index   48 bytes per entry: offset, data size, padded size, type tag, flags, MAC
+//   data    the ciphertext of every entry, padded to 16 bytes and aligned on 64 bytes
+// The file key is derived from the wrapping key and the random salt of the file. Every entry is sealed on its
+// own with ChaCha20-Poly1305 (RFC 8439) under the nonce id + 1, its index fields are the associated data.
+// The header is sealed under the nonce 0, so a file cut short or with entries swapped is rejected.
+// An entry is authenticated before a byte of it is decrypted, a tampered entry leaves its SecuredPtr empty.
+// SecureTypeTag<T> names the serialization of T in the file, specialize it for types with their own SecureTraits.
+
+#include "SecuredPtr.h"
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Secured_Ptr
+{
+    //Tag stored with an entry and checked when it is loaded: the kind of serialization and its unit size
+    template <typename T, typename Enable = void> struct SecureTypeTag
+    {
+        static constexpr uint32_t Value = SecureTraits<T>::FixedSize ? 0x10000000u | (uint32_t)(SecureTraits<T>::Size & 0x0fffffff) : 0x20000000u;
+    };
+
+    template <typename Char, typename CharTraits, typename Alloc>
+    struct SecureTypeTag<std::basic_string<Char, CharTraits, Alloc>>
+    {
+        static constexpr uint32_t Value = 0x30000000u | (uint32_t)sizeof(Char);
+    };
+
+    template <typename U, typename Alloc>
+    struct SecureTypeTag<std::vector<U, Alloc>>
+    {
+        static constexpr uint32_t Value = 0x40000000u | (uint32_t)(sizeof(U) & 0x0fffffff);
+    };
+
+    //ChaCha20 and Poly1305 as specified by RFC 8439, portable and independent of the crypto backend since
+    //the file may be written and read by different builds
+    class SecureFileCrypto
+    {
+    public:
+        static constexpr size_t KeySize = 32;
+        static constexpr size_t MacSize = 16;
+
+        //Keystream block counter of nonce (a 64 bit nonce after 32 zero bits)
+        static void ChaCha20Block(const BYTE* key, uint64_t nonce, uint32_t counter, BYTE* out)
+        {
+            uint32_t input[16] = {
+                0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+                Load32(key), Load32(key + 4), Load32(key + 8), Load32(key + 12),
+                Load32(key + 16), Load32(key + 20), Load32(key + 24), Load32(key + 28),
+                counter, 0, (uint32_t)nonce, (uint32_t)(nonce >> 32) };
+            uint32_t x[16];
+            memcpy(x, input, sizeof(x));
+            for (int i = 0; i < 10; i++)
+            {
+                QuarterRound(x, 0, 4, 8, 12);
+                QuarterRound(x, 1, 5, 9, 13);
+                QuarterRound(x, 2, 6, 10, 14);
+                QuarterRound(x, 3, 7, 11, 15);
+                QuarterRound(x, 0, 5, 10, 15);
+                QuarterRound(x, 1, 6, 11, 12);
+                QuarterRound(x, 2, 7, 8, 13);
+                QuarterRound(x, 3, 4, 9, 14);
+            }
+            for (int i = 0; i < 16; i++)
+                Store32(out + 4 * i, x[i] + input[i]);
+            SecureZeroMemory(x, sizeof(x));
+            SecureZeroMemory(input, sizeof(input));
+        }
+
+        //dest = src XOR the keystream of nonce from byte offset on, the counter starting at 1 like RFC 8439.
+        //src and dest may be the same buffer.
+        static void Xor(const BYTE* key, uint64_t nonce, size_t offset, const BYTE* src, PBYTE dest, size_t len)
+        {
+            BYTE block[64];
+            while (len > 0)
+            {
+                size_t skip = offset % 64;
+                size_t n = 64 - skip < len ? 64 - skip : len;
+                ChaCha20Block(key, nonce, (uint32_t)(offset / 64 + 1), block);
+                for (size_t i = 0; i < n; i++)
+                    dest[i] = src[i] ^ block[skip + i];
+                offset += n;
+                src += n;
+                dest += n;
+                len -= n;
+            }
+            SecureZeroMemory(block, sizeof(block));
+        }
+
+        //Poly1305 tag of aad and ciphertext under the one time key of nonce, the AEAD construction of RFC 8439
+        static void Mac(const BYTE* key, uint64_t nonce, const BYTE* aad, size_t aadLen, const BYTE* ciphertext, size_t len, BYTE* tag)
+        {
+            BYTE block[64];
+            ChaCha20Block(key, nonce, 0, block);
+            Poly1305 poly(block);
+            SecureZeroMemory(block, sizeof(block));
+            static const BYTE zeros[16] = {};
+            poly.Update(aad, aadLen);
+            poly.Update(zeros, (16 - aadLen % 16) % 16);
+            poly.Update(ciphertext, len);
+            poly.Update(zeros, (16 - len % 16) % 16);
+            BYTE lengths[16];
+            Store64(lengths, aadLen);
+            Store64(lengths + 8, len);
+            poly.Update(lengths, sizeof(lengths));
+            poly.Finish(tag);
+        }
+
+        static inline uint32_t Load32(const BYTE* p)
+        {
+            return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+        }
+
+        static inline uint64_t Load64(const BYTE* p)
+        {
+            return (uint64_t)Load32(p) | ((uint64_t)Load32(p + 4) << 32);
+        }
+
+        static inline void Store32(BYTE* p, uint32_t v)
+        {
+            p[0] = (BYTE)v;
+            p[1] = (BYTE)(v >> 8);
+            p[2] = (BYTE)(v >> 16);
+            p[3] = (BYTE)(v >> 24);
+        }
+
+        static inline void Store64(BYTE* p, uint64_t v)
+        {
+            Store32(p, (uint32_t)v);
+            Store32(p + 4, (uint32_t)(v >> 32));
+        }
+
+    private:
+        static inline uint32_t Rotl(uint32_t v, int c)
+        {
+            return (v << c) | (v >> (32 - c));
+        }
+
+        static inline void QuarterRound(uint32_t* x, int a, int b, int c, int d)
+        {
+            x[a] += x[b]; x[d] = Rotl(x[d] ^ x[a], 16);
+            x[c] += x[d]; x[b] = Rotl(x[b] ^ x[c], 12);
+            x[a] += x[b]; x[d] = Rotl(x[d] ^ x[a], 8);
+            x[c] += x[d]; x[b] = Rotl(x[b] ^ x[c], 7);
+        }
+
+        //Incremental Poly1305 in 26 bit limbs, which only needs 64 bit products
+        class Poly1305
+        {
+        public:
+            explicit Poly1305(const BYTE* key)
+            {
+                r[0] = Load32(key) & 0x3ffffff;
+                r[1] = (Load32(key + 3) >> 2) & 0x3ffff03;
+                r[2] = (Load32(key + 6) >> 4) & 0x3ffc0ff;
+                r[3] = (Load32(key + 9) >> 6) & 0x3f03fff;
+                r[4] = (Load32(key + 12) >> 8) & 0x00fffff;
+                for (int i = 0; i < 4; i++)
+                    pad[i] = Load32(key + 16 + 4 * i);
+            }
+
+            ~Poly1305()
+            {
+                SecureZeroMemory(r, sizeof(r));
+                SecureZeroMemory(h, sizeof(h));
+                SecureZeroMemory(pad, sizeof(pad));
+                SecureZeroMemory(buffer, sizeof(buffer));
+            }
+
+            void Update(const BYTE* data, size_t len)
+            {
+                if (len == 0)
+                    return;
+                if (pending > 0)
+                {
+                    size_t n = 16 - pending < len ? 16 - pending : len;
+                    memcpy(buffer + pending, data, n);
+                    pending += n;
+                    data += n;
+                    len -= n;
+                    if (pending < 16)
+                        return;
+                    Blocks(buffer, 16, 1 << 24);
+                    pending = 0;
+                }
+                size_t whole = len & ~(size_t)15;
+                Blocks(data, whole, 1 << 24);
+                memcpy(buffer, data + whole, len - whole);
+                pending = len - whole;
+            }
+
+            void Finish(BYTE* tag)
+            {
+                if (pending > 0)
+                {
+                    buffer[pending] = 1;
+                    memset(buffer + pending + 1, 0, 15 - pending);
+                    Blocks(buffer, 16, 0);
+                }
+                uint32_t c;
+                c = h[1] >> 26; h[1] &= 0x3ffffff;
+                h[2] += c; c = h[2] >> 26; h[2] &= 0x3ffffff;
+                h[3] += c; c = h[3] >> 26; h[3] &= 0x3ffffff;
+                h[4] += c; c = h[4] >> 26; h[4] &= 0x3ffffff;
+                h[0] += c * 5; c = h[0] >> 26; h[0] &= 0x3ffffff;
+                h[1] += c;
+
+                //h - p, kept when h >= p, selected without a branch
+                uint32_t g[5];
+                g[0] = h[0] + 5; c = g[0] >> 26; g[0] &= 0x3ffffff;
+                g[1] = h[1] + c; c = g[1] >> 26; g[1] &= 0x3ffffff;
+                g[2] = h[2] + c; c = g[2] >> 26; g[2] &= 0x3ffffff;
+                g[3] = h[3] + c; c = g[3] >> 26; g[3] &= 0x3ffffff;
+                g[4] = h[4] + c - (1 << 26);
+                uint32_t mask = (g[4] >> 31) - 1;
+                for (int i = 0; i < 5; i++)
+                    h[i] = (h[i] & ~mask) | (g[i] & mask);
+
+                uint32_t w[4] = {
+                    h[0] | (h[1] << 26),
+                    (h[1] >> 6) | (h[2] << 20),
+                    (h[2] >> 12) | (h[3] << 14),
+                    (h[3] >> 18) | (h[4] << 8) };
+                uint64_t f = 0;
+                for (int i = 0; i < 4; i++)
+                {
+                    f = (uint64_t)w[i] + pad[i] + (f >> 32);
+                    Store32(tag + 4 * i, (uint32_t)f);
+                }
+            }
+
+        private:
+            uint32_t r[5];
+            uint32_t h[5] = {};
+            uint32_t pad[4];
+            BYTE buffer[16];
+            size_t pending = 0;
+
+            void Blocks(const BYTE* m, size_t len, uint32_t hibit)
+            {
+                uint32_t s1 = r[1] * 5, s2 = r[2] * 5, s3 = r[3] * 5, s4 = r[4] * 5;
+                for (; len >= 16; m += 16, len -= 16)
+                {
+                    h[0] += Load32(m) & 0x3ffffff;
+                    h[1] += (Load32(m + 3) >> 2) & 0x3ffffff;
+                    h[2] += (Load32(m + 6) >> 4) & 0x3ffffff;
+                    h[3] += (Load32(m + 9) >> 6) & 0x3ffffff;
+                    h[4] += (Load32(m + 12) >> 8) | hibit;
+
+                    uint64_t d0 = (uint64_t)h[0] * r[0] + (uint64_t)h[1] * s4 + (uint64_t)h[2] * s3 + (uint64_t)h[3] * s2 + (uint64_t)h[4] * s1;
+                    uint64_t d1 = (uint64_t)h[0] * r[1] + (uint64_t)h[1] * r[0] + (uint64_t)h[2] * s4 + (uint64_t)h[3] * s3 + (uint64_t)h[4] * s2;
+                    uint64_t d2 = (uint64_t)h[0] * r[2] + (uint64_t)h[1] * r[1] + (uint64_t)h[2] * r[0] + (uint64_t)h[3] * s4 + (uint64_t)h[4] * s3;
+                    uint64_t d3 = (uint64_t)h[0] * r[3] + (uint64_t)h[1] * r[2] + (uint64_t)h[2] * r[1] + (uint64_t)h[3] * r[0] + (uint64_t)h[4] * s4;
+                    uint64_t d4 = (uint64_t)h[0] * r[4] + (uint64_t)h[1] * r[3] + (uint64_t)h[2] * r[2] + (uint64_t)h[3] * r[1] + (uint64_t)h[4] * r[0];
+
+                    uint32_t c = (uint32_t)(d0 >> 26); h[0] = (uint32_t)d0 & 0x3ffffff;
+                    d1 += c; c = (uint32_t)(d1 >> 26); h[1] = (uint32_t)d1 & 0x3ffffff;
+                    d2 += c; c = (uint32_t)(d2 >> 26); h[2] = (uint32_t)d2 & 0x3ffffff;
+                    d3 += c; c = (uint32_t)(d3 >> 26); h[3] = (uint32_t)d3 & 0x3ffffff;
+                    d4 += c; c = (uint32_t)(d4 >> 26); h[4] = (uint32_t)d4 & 0x3ffffff;
+                    h[0] += c * 5; c = h[0] >> 26; h[0] &= 0x3ffffff;
+                    h[1] += c;
+                }
+            }
+        };
+    };
+
+    //Layout shared by SecureFileWriter and SecureFile
+    struct SecureFileFormat
+    {
+        static constexpr char Magic[8] = { 'S', 'P', 'S', 'E', 'A', 'L', 'D', '1' };
+        static constexpr uint32_t Version = 1;
+        static constexpr size_t HeaderSize = 64;
+        static constexpr size_t HeaderSealed = 48;  //Bytes of the header covered by its MAC, the MAC follows
+        static constexpr size_t EntrySize = 48;
+        static constexpr size_t EntrySealed = 32;   //Bytes of an entry given to its MAC with the id, the MAC follows
+        static constexpr size_t DataAlignment = 64;
+        static constexpr size_t MaxDataSize = (size_t)1 << 37; //The 32 bit block counter of one nonce
+
+        static size_t Pad(size_t dataSize)
+        {
+            return (dataSize + 15) & ~(size_t)15;
+        }
+
+        //Associated data of entry id: its id followed by its index fields before the MAC
+        static void EntryAad(size_t id, const BYTE* entry, BYTE* aad)
+        {
+            SecureFileCrypto::Store64(aad, (uint64_t)id);
+            memcpy(aad + 8, entry + 8, EntrySealed - 8);
+        }
+
+        //File key of wrappingKey and the salt of the file
+        static void DeriveKey(const BYTE* wrappingKey, uint64_t salt, BYTE* fileKey)
+        {
+            BYTE block[64];
+            SecureFileCrypto::ChaCha20Block(wrappingKey, salt, 0, block);
+            memcpy(fileKey, block, SecureFileCrypto::KeySize);
+            SecureZeroMemory(block, sizeof(block));
+        }
+    };
+
+    //Collects the ciphertext of SecuredPtr values, then writes the sealed file at once.
+    //Values are read from their SecuredPtr one chunk at a time and encrypted straight into the file image,
+    //which only ever holds ciphertext.
+    class SecureFileWriter
+    {
+    public:
+        static constexpr size_t InvalidId = (size_t)-1;
+
+        //wrappingKey: 32 bytes, copied
+        explicit SecureFileWriter(const BYTE* wrappingKey)
+            : key(DefaultSecureAllocator::Allocate(SecureFileCrypto::KeySize)), salt(0)
+        {
+            bool salted;
+#ifdef _WIN32
+            salted = BCryptGenRandom(nullptr, (PUCHAR)&salt, sizeof(salt), BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0;
+#else
+            salted = getrandom(&salt, sizeof(salt), 0) == (ssize_t)sizeof(salt);
+#endif
+            if (key != nullptr && (!salted || wrappingKey == nullptr))
+            {
+                DefaultSecureAllocator::Deallocate(key, SecureFileCrypto::KeySize);
+                key = nullptr;
+            }
+            if (key != nullptr)
+                SecureFileFormat::DeriveKey(wrappingKey, salt, key);
+        }
+        SecureFileWriter(const SecureFileWriter&) = delete;
+        SecureFileWriter& operator=(const SecureFileWriter&) = delete;
+
+        ~SecureFileWriter()
+        {
+            if (key != nullptr)
+                DefaultSecureAllocator::Deallocate(key, SecureFileCrypto::KeySize);
+        }
+
+        //Encrypts the value of secret into the file and returns its id, InvalidId when it is empty or unreadable
+        template <typename T, typename Backend, typename Allocator, size_t InlineSize>
+        size_t Add(const SecuredPtr<T, Backend, Allocator, InlineSize>& secret)
+        {
+            if (key == nullptr)
+                return InvalidId;
+            size_t id = Count();
+            uint64_t nonce = (uint64_t)id + 1;
+            size_t offset = (data.size() + SecureFileFormat::DataAlignment - 1) & ~(SecureFileFormat::DataAlignment - 1);
+            data.resize(offset);
+            size_t dataSize = 0;
+            bool ok = secret.StreamOut([&](const BYTE* chunk, size_t n) -> bool {
+                if (dataSize + n > SecureFileFormat::MaxDataSize)
+                    return false;
+                data.resize(offset + dataSize + n);
+                SecureFileCrypto::Xor(key, nonce, dataSize, chunk, data.data() + offset + dataSize, n);
+                dataSize += n;
+                return true;
+                });
+            if (!ok || dataSize == 0)
+            {
+                data.resize(offset);
+                return InvalidId;
+            }
+            //The padding is encrypted zeros
+            size_t paddedSize = SecureFileFormat::Pad(dataSize);
+            data.resize(offset + paddedSize);
+            memset(data.data() + offset + dataSize, 0, paddedSize - dataSize);
+            PBYTE padding = data.data() + offset + dataSize;
+            SecureFileCrypto::Xor(key, nonce, dataSize, padding, padding, paddedSize - dataSize);
+
+            //The offset is relative to the data section till Save() knows where it starts
+            BYTE entry[SecureFileFormat::EntrySize];
+            SecureFileCrypto::Store64(entry, offset);
+            SecureFileCrypto::Store64(entry + 8, dataSize);
+            SecureFileCrypto::Store64(entry + 16, paddedSize);
+            SecureFileCrypto::Store32(entry + 24, SecureTypeTag<T>::Value);
+            SecureFileCrypto::Store32(entry + 28, 0);
+            BYTE aad[SecureFileFormat::EntrySealed];
+            SecureFileFormat::EntryAad(id, entry, aad);
+            SecureFileCrypto::Mac(key, nonce, aad, sizeof(aad), data.data() + offset, paddedSize, entry + SecureFileFormat::EntrySealed);
+            index.insert(index.end(), entry, entry + sizeof(entry));
+            return id;
+        }
+
+        size_t Count() const
+        {
+            return index.size() / SecureFileFormat::EntrySize;
+        }
+
+        //Writes the file next to path and renames it over path once complete, false on any error
+        bool Save(const char* path)
+        {
+            if (key == nullptr || path == nullptr)
+                return false;
+            size_t count = Count();
+            size_t indexOffset = SecureFileFormat::HeaderSize;
+            size_t dataOffset = (indexOffset + index.size() + SecureFileFormat::DataAlignment - 1) & ~(SecureFileFormat::DataAlignment - 1);
+
+            BYTE header[SecureFileFormat::HeaderSize] = {};
+            memcpy(header, SecureFileFormat::Magic, sizeof(SecureFileFormat::Magic));
+            SecureFileCrypto::Store32(header + 8, SecureFileFormat::Version);
+            SecureFileCrypto::Store32(header + 12, (uint32_t)SecureFileFormat::EntrySize);
+            SecureFileCrypto::Store64(header + 16, count);
+            SecureFileCrypto::Store64(header + 24, indexOffset);
+            SecureFileCrypto::Store64(header + 32, dataOffset);
+            SecureFileCrypto::Store64(header + 40, salt);
+            SecureFileCrypto::Mac(key, 0, header, SecureFileFormat::HeaderSealed, nullptr, 0, header + SecureFileFormat::HeaderSealed);
+
+            //Offsets become absolute, the MAC of an entry does not cover its offset
+            std::vector<BYTE> fileIndex(index);
+            for (size_t i = 0; i < count; i++)
+            {
+                PBYTE entry = fileIndex.data() + i * SecureFileFormat::EntrySize;
+                SecureFileCrypto::Store64(entry, SecureFileCrypto::Load64(entry) + dataOffset);
+            }
+
+            std::string temp = std::string(path) + ".tmp";
+            FILE* file = fopen(temp.c_str(), "wb");
+            if (file == nullptr)
+                return false;
+            static const BYTE zeros[SecureFileFormat::DataAlignment] = {};
+            bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+                fwrite(fileIndex.data(), 1, fileIndex.size(), file) == fileIndex.size() &&
+                fwrite(zeros, 1, dataOffset - indexOffset - fileIndex.size(), file) == dataOffset - indexOffset - fileIndex.size() &&
+                fwrite(data.data(), 1, data.size(), file) == data.size();
+            ok = fflush(file) == 0 && ok;
+#ifndef _WIN32
+            ok = ok && fsync(fileno(file)) == 0;
+#endif
+            ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+            ok = ok && MoveFileExA(temp.c_str(), path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+            ok = ok && rename(temp.c_str(), path) == 0;
+#endif
+            if (!ok)
+                remove(temp.c_str());
+            return ok;
+        }
+
+    private:
+        PBYTE key;
+        uint64_t salt;
+        std::vector<BYTE> index; //Entries of EntrySize bytes
+        std::vector<BYTE> data;  //Ciphertext of the entries
+    };
+
+    //Read-only view of a sealed file mapped in memory, shared by the SecureFile that opened it and the
+    //entries not loaded yet
+    class SecureFileMapping
+    {
+    public:
+        SecureFileMapping() : base(nullptr), size(0), count(0), indexOffset(0), key(nullptr)
+#ifdef _WIN32
+            , file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#endif
+        {
+        }
+        SecureFileMapping(const SecureFileMapping&) = delete;
+        SecureFileMapping& operator=(const SecureFileMapping&) = delete;
+
+        ~SecureFileMapping()
+        {
+            if (key != nullptr)
+                DefaultSecureAllocator::Deallocate(key, SecureFileCrypto::KeySize);
+#ifdef _WIN32
+            if (base != nullptr)
+                UnmapViewOfFile(base);
+            if (mapping != nullptr)
+                CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+#else
+            if (base != nullptr)
+                munmap(const_cast<BYTE*>(base), size);
+#endif
+        }
+
+        //Maps path and checks its header, the entries are only looked at when they are used
+        bool Open(const char* path, const BYTE* wrappingKey)
+        {
+            if (!Map(path) || size < SecureFileFormat::HeaderSize || wrappingKey == nullptr)
+                return false;
+            const BYTE* header = base;
+            if (memcmp(header, SecureFileFormat::Magic, sizeof(SecureFileFormat::Magic)) != 0 ||
+                SecureFileCrypto::Load32(header + 8) != SecureFileFormat::Version ||
+                SecureFileCrypto::Load32(header + 12) != SecureFileFormat::EntrySize)
+                return false;
+            key = DefaultSecureAllocator::Allocate(SecureFileCrypto::KeySize);
+            if (key == nullptr)
+                return false;
+            SecureFileFormat::DeriveKey(wrappingKey, SecureFileCrypto::Load64(header + 40), key);
+            BYTE mac[SecureFileCrypto::MacSize];
+            SecureFileCrypto::Mac(key, 0, header, SecureFileFormat::HeaderSealed, nullptr, 0, mac);
+            if (!SecureCompare::Equal(mac, header + SecureFileFormat::HeaderSealed, sizeof(mac)))
+                return false;
+            uint64_t entries = SecureFileCrypto::Load64(header + 16);
+            uint64_t offset = SecureFileCrypto::Load64(header + 24);
+            if (offset < SecureFileFormat::HeaderSize || offset > size || entries > (size - offset) / SecureFileFormat::EntrySize)
+                return false;
+            count = (size_t)entries;
+            indexOffset = (size_t)offset;
+            return true;
+        }
+
+        size_t Count() const
+        {
+            return count;
+        }
+
+        //Index entry of id with its ciphertext inside the file, nullptr otherwise
+        const BYTE* Entry(size_t id) const
+        {
+            if (id >= count)
+                return nullptr;
+            const BYTE* entry = base + indexOffset + id * SecureFileFormat::EntrySize;
+            return IsValidEntry(entry) ? entry : nullptr;
+        }
+
+        //Authenticates entry id, then decrypts its data to dest when given, which holds destSize bytes.
+        //The mapping does not snapshot the file, so the entry and its ciphertext are copied once and only the
+        //copies are checked and decrypted: a writer changing the file meanwhile cannot slip in unchecked bytes.
+        //The file must not be truncated while it is mapped, reading past its end raises SIGBUS.
+        bool Unseal(size_t id, PBYTE dest, size_t destSize = 0) const
+        {
+            if (id >= count)
+                return false;
+            BYTE entry[SecureFileFormat::EntrySize];
+            memcpy(entry, base + indexOffset + id * SecureFileFormat::EntrySize, sizeof(entry));
+            if (!IsValidEntry(entry))
+                return false;
+            size_t dataSize = (size_t)SecureFileCrypto::Load64(entry + 8);
+            size_t paddedSize = (size_t)SecureFileCrypto::Load64(entry + 16);
+            if (dest != nullptr && dataSize != destSize)
+                return false;
+            PBYTE ciphertext = DefaultSecureAllocator::Allocate(paddedSize);
+            if (ciphertext == nullptr)
+                return false;
+            memcpy(ciphertext, base + SecureFileCrypto::Load64(entry), paddedSize);
+            BYTE aad[SecureFileFormat::EntrySealed];
+            BYTE mac[SecureFileCrypto::MacSize];
+            SecureFileFormat::EntryAad(id, entry, aad);
+            SecureFileCrypto::Mac(key, (uint64_t)id + 1, aad, sizeof(aad), ciphertext, paddedSize, mac);
+            bool ok = SecureCompare::Equal(mac, entry + SecureFileFormat::EntrySealed, sizeof(mac));
+            if (ok && dest != nullptr)
+                SecureFileCrypto::Xor(key, (uint64_t)id + 1, 0, ciphertext, dest, dataSize);
+            DefaultSecureAllocator::Deallocate(ciphertext, paddedSize);
+            return ok;
+        }
+
+    private:
+        const BYTE* base;
+        size_t size;
+        size_t count;
+        size_t indexOffset;
+        PBYTE key;
+#ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+#endif
+
+        //Whether the sizes of entry are sane and its ciphertext lies inside the file
+        bool IsValidEntry(const BYTE* entry) const
+        {
+            uint64_t offset = SecureFileCrypto::Load64(entry);
+            uint64_t dataSize = SecureFileCrypto::Load64(entry + 8);
+            uint64_t paddedSize = SecureFileCrypto::Load64(entry + 16);
+            return dataSize != 0 && dataSize <= SecureFileFormat::MaxDataSize && paddedSize == SecureFileFormat::Pad((size_t)dataSize) &&
+                offset <= size && paddedSize <= size - offset;
+        }
+
+        bool Map(const char* path)
+        {
+            if (path == nullptr)
+                return false;
+#ifdef _WIN32
+            file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            LARGE_INTEGER fileSize;
+            if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+                return false;
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping == nullptr)
+                return false;
+            base = static_cast<const BYTE*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            size = (size_t)fileSize.QuadPart;
+            return base != nullptr;
+#else
+            int fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            void* view = MAP_FAILED;
+            if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+                view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (view == MAP_FAILED)
+                return false;
+            base = static_cast<const BYTE*>(view);
+            size = (size_t)st.st_size;
+            return true;
+#endif
+        }
+    };
+
+    //Sealed file opened for reading. Get() attaches an entry to a SecuredPtr without reading it: the entry is
+    //authenticated, decrypted and encrypted again under the process key the first time the SecuredPtr is used.
+    //The file stays mapped while a SecuredPtr holds an entry not loaded yet, even after Close().
+    class SecureFile
+    {
+    public:
+        static constexpr size_t InvalidId = (size_t)-1;
+
+        //Maps path and checks its header and its MAC under wrappingKey (32 bytes), false when the file is not a
+        //sealed file, was changed or was sealed under another key
+        bool Open(const char* path, const BYTE* wrappingKey)
+        {
+            std::shared_ptr<SecureFileMapping> opened = std::make_shared<SecureFileMapping>();
+            mapping.reset();
+            if (!opened->Open(path, wrappingKey))
+                return false;
+            mapping = std::move(opened);
+            return true;
+        }
+
+        void Close()
+        {
+            mapping.reset();
+        }
+
+        bool IsOpen() const
+        {
+            return mapping != nullptr;
+        }
+
+        size_t Count() const
+        {
+            return mapping != nullptr ? mapping->Count() : 0;
+        }
+
+        //Gives entry id to dest, loaded on its first use. False when there is no such entry or it was saved
+        //from another type, dest is then unchanged. Its MAC is only checked by the load, see Verify().
+        template <typename T, typename Backend, typename Allocator, size_t InlineSize>
+        bool Get(size_t id, SecuredPtr<T, Backend, Allocator, InlineSize>& dest) const
+        {
+            const BYTE* entry = mapping != nullptr ? mapping->Entry(id) : nullptr;
+            if (entry == nullptr || SecureFileCrypto::Load32(entry + 24) != SecureTypeTag<T>::Value)
+                return false;
+            size_t dataSize = (size_t)SecureFileCrypto::Load64(entry + 8);
+            if constexpr (SecureTraits<T>::FixedSize)
+            {
+                if (dataSize != SecureTraits<T>::Size)
+                    return false;
+            }
+            dest.LoadOnFirstUse(std::make_shared<Source>(mapping, id, dataSize));
+            return true;
+        }
+
+        //Whether entry id is intact, its data stays encrypted
+        bool Verify(size_t id) const
+        {
+            return mapping != nullptr && mapping->Unseal(id, nullptr);
+        }
+
+    private:
+        std::shared_ptr<const SecureFileMapping> mapping;
+
+        class Source : public SecureLazySource
+        {
+        public:
+            Source(std::shared_ptr<const SecureFileMapping> file, size_t entryId, size_t entrySize)
+                : mapping(std::move(file)), id(entryId), dataSize(entrySize)
+            {
+            }
+
+            size_t GetSize() const override
+            {
+                return dataSize;
+            }
+
+            bool Read(PBYTE dest) const override
+            {
+                if (mapping->Unseal(id, dest, dataSize))
+                    return true;
+                SecureZeroMemory(dest, dataSize);
+                return false;
+            }
+
+        private:
+            std::shared_ptr<const SecureFileMapping> mapping;
+            size_t id;
+            size_t dataSize;
+        };
+    };
+}
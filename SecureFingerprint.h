@@ -0,0 +1,136 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// Keyed fingerprints of secrets: SipHash-2-4 under a random per-process key kept in a locked page
+// excluded from core dumps. Equal secrets have equal fingerprints inside one process while the
+// fingerprint tells nothing about the secret to anybody without the key.
+// SecuredPtr stores the fingerprint next to its encrypted data when _SecuredFingerprint is defined,
+// '==' and std::hash then work without decrypting.
+
+#include "SecureCryptBackend.h"
+
+#ifdef _WIN32
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+#endif
+
+namespace Secured_Ptr
+{
+    class SecureFingerprint
+    {
+    public:
+        //0 is never returned, SecuredPtr uses it for an unknown fingerprint
+        static uint64_t Compute(const void* data, size_t len)
+        {
+            const uint64_t* key = GetProcessKey();
+            if (key == nullptr)
+                return 0;
+            uint64_t fingerprint = SipHash(key, static_cast<const BYTE*>(data), len);
+            return fingerprint != 0 ? fingerprint : 1;
+        }
+
+        //SipHash-2-4 of data under key[0..1]
+        static uint64_t SipHash(const uint64_t* key, const BYTE* data, size_t len)
+        {
+            uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+            uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+            uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+            uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+
+            size_t end = len - (len % 8);
+            for (size_t i = 0; i < end; i += 8)
+            {
+                uint64_t m = Load64(data + i);
+                v3 ^= m;
+                Round(v0, v1, v2, v3);
+                Round(v0, v1, v2, v3);
+                v0 ^= m;
+            }
+
+            uint64_t last = (uint64_t)len << 56;
+            for (size_t i = 0; i < len % 8; i++)
+                last |= (uint64_t)data[end + i] << (8 * i);
+            v3 ^= last;
+            Round(v0, v1, v2, v3);
+            Round(v0, v1, v2, v3);
+            v0 ^= last;
+
+            v2 ^= 0xff;
+            for (int i = 0; i < 4; i++)
+                Round(v0, v1, v2, v3);
+            return v0 ^ v1 ^ v2 ^ v3;
+        }
+
+    private:
+        static inline uint64_t Rotl(uint64_t v, int c)
+        {
+            return (v << c) | (v >> (64 - c));
+        }
+
+        //Little endian load, a single move on little endian hosts
+        static inline uint64_t Load64(const BYTE* p)
+        {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || defined(_WIN32)
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+#else
+            uint64_t v = 0;
+            for (int i = 7; i >= 0; i--)
+                v = (v << 8) | p[i];
+            return v;
+#endif
+        }
+
+        static inline void Round(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3)
+        {
+            v0 += v1; v1 = Rotl(v1, 13); v1 ^= v0; v0 = Rotl(v0, 32);
+            v2 += v3; v3 = Rotl(v3, 16); v3 ^= v2;
+            v0 += v3; v3 = Rotl(v3, 21); v3 ^= v0;
+            v2 += v1; v1 = Rotl(v1, 17); v1 ^= v2; v2 = Rotl(v2, 32);
+        }
+
+        static uint64_t* CreateProcessKey()
+        {
+#ifdef _WIN32
+            void* page = VirtualAlloc(nullptr, 4096, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            if (page == nullptr)
+                return nullptr;
+            //Best effort, the key still works when the working set cannot be locked
+            VirtualLock(page, 4096);
+            if (BCryptGenRandom(nullptr, (PUCHAR)page, 16, BCRYPT_USE_SYSTEM_PREFERRED_RNG) != 0)
+            {
+                VirtualFree(page, 0, MEM_RELEASE);
+                return nullptr;
+            }
+#else
+            size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+            void* page = mmap(nullptr, pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (page == MAP_FAILED)
+                return nullptr;
+            //Best effort, the key still works when the memlock limit is exhausted
+            mlock(page, pageSize);
+            madvise(page, pageSize, MADV_DONTDUMP);
+            if (getrandom(page, 16, 0) != 16)
+            {
+                munmap(page, pageSize);
+                return nullptr;
+            }
+#endif
+            return static_cast<uint64_t*>(page);
+        }
+
+        static const uint64_t* GetProcessKey()
+        {
+            static const uint64_t* key = CreateProcessKey();
+            return key;
+        }
+    };
+}
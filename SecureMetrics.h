@@ -0,0 +1,325 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// Optional instrumentation of SecuredPtr, compiled in by defining _SecuredMetrics for the whole program.
+// Without it SecuredPtr has no hook, no clock read and no extra field and Snapshot() is empty.
+// Every SecuredPtr<T> counts its encryptions, decryptions, secure allocations, wipes and waits (on a lock or
+// on a block another thread is encrypting) in counters of T, with log2 histograms of how long they took.
+// The exposure histogram records how long data stayed in clear: from its decryption (or creation) to its
+// re-encryption, and the life of the copies handed out by '&' and '->'.
+// Counts are exact and cost one relaxed atomic increment. A clock read costs more than a small encryption,
+// so only one crypto call or exposure in SetSampling() (16 by default) per thread is timed, waits always are.
+// The process totals are only summed up by Snapshot().
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Secured_Ptr
+{
+    //Durations in nanoseconds: bucket i counts [2^i, 2^(i+1)), bucket 0 also 0 and the last one everything above
+    struct SecureHistogram
+    {
+        static constexpr size_t BucketCount = 40;
+
+        uint64_t count;
+        uint64_t totalNs;
+        uint64_t buckets[BucketCount];
+
+        double MeanNs() const
+        {
+            return count > 0 ? (double)totalNs / count : 0;
+        }
+
+        //Upper bound of the bucket holding the fraction p (0..1) of the durations
+        uint64_t PercentileNs(double p) const
+        {
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BucketCount; i++)
+            {
+                seen += buckets[i];
+                if (count > 0 && seen >= p * count)
+                    return (uint64_t)2 << i;
+            }
+            return 0;
+        }
+
+        void Add(const SecureHistogram& other)
+        {
+            count += other.count;
+            totalNs += other.totalNs;
+            for (size_t i = 0; i < BucketCount; i++)
+                buckets[i] += other.buckets[i];
+        }
+    };
+
+    struct SecureTypeMetrics
+    {
+        const char* type;          //typeid(T).name(), "*" for the process totals
+        uint64_t allocations;      //Buffers taken from the secure allocator
+        uint64_t allocatedBytes;
+        uint64_t wipes;            //Buffers wiped when released
+        uint64_t wipedBytes;
+        uint64_t encryptions;      //Protect() and encrypted ranges
+        uint64_t decryptions;      //Unprotect() and decrypted ranges
+        SecureHistogram encrypt;   //Sampled
+        SecureHistogram decrypt;   //Sampled
+        SecureHistogram lockWait;  //Every wait on a lock or a busy block, uncontended calls record nothing
+        SecureHistogram exposure;  //Sampled time the data stayed decrypted
+
+        void Add(const SecureTypeMetrics& other)
+        {
+            allocations += other.allocations;
+            allocatedBytes += other.allocatedBytes;
+            wipes += other.wipes;
+            wipedBytes += other.wipedBytes;
+            encryptions += other.encryptions;
+            decryptions += other.decryptions;
+            encrypt.Add(other.encrypt);
+            decrypt.Add(other.decrypt);
+            lockWait.Add(other.lockWait);
+            exposure.Add(other.exposure);
+        }
+    };
+
+    struct SecureMetricsSnapshot
+    {
+        bool enabled;                          //Built with _SecuredMetrics
+        SecureTypeMetrics total;
+        std::vector<SecureTypeMetrics> types;  //One entry per T used so far
+    };
+
+    class SecureMetrics
+    {
+    public:
+        //Live histogram, updated with relaxed atomics
+        class Histogram
+        {
+        public:
+            void Record(uint64_t ns)
+            {
+                count.fetch_add(1, std::memory_order_relaxed);
+                totalNs.fetch_add(ns, std::memory_order_relaxed);
+                buckets[Bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void Load(SecureHistogram& h) const
+            {
+                h.count = count.load(std::memory_order_relaxed);
+                h.totalNs = totalNs.load(std::memory_order_relaxed);
+                for (size_t i = 0; i < SecureHistogram::BucketCount; i++)
+                    h.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+            }
+
+        private:
+            std::atomic<uint64_t> count{ 0 };
+            std::atomic<uint64_t> totalNs{ 0 };
+            std::atomic<uint64_t> buckets[SecureHistogram::BucketCount] = {};
+
+            static size_t Bucket(uint64_t ns)
+            {
+                if (ns < 2)
+                    return 0;
+#if defined(__GNUC__) || defined(__clang__)
+                size_t i = 63 - (size_t)__builtin_clzll(ns);
+#elif defined(_MSC_VER)
+                unsigned long index;
+                _BitScanReverse64(&index, ns);
+                size_t i = index;
+#else
+                size_t i = 0;
+                while (ns >>= 1)
+                    i++;
+#endif
+                return i < SecureHistogram::BucketCount ? i : SecureHistogram::BucketCount - 1;
+            }
+        };
+
+        //Live counters of one type, never destroyed so that static SecuredPtr objects can use them till exit
+        class Counters
+        {
+        public:
+            std::atomic<uint64_t> allocations{ 0 };
+            std::atomic<uint64_t> allocatedBytes{ 0 };
+            std::atomic<uint64_t> wipes{ 0 };
+            std::atomic<uint64_t> wipedBytes{ 0 };
+            std::atomic<uint64_t> encryptions{ 0 };
+            std::atomic<uint64_t> decryptions{ 0 };
+            Histogram encrypt;
+            Histogram decrypt;
+            Histogram lockWait;
+            Histogram exposure;
+
+            void Allocated(size_t bytes)
+            {
+                allocations.fetch_add(1, std::memory_order_relaxed);
+                allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+            }
+
+            void Wiped(size_t bytes)
+            {
+                wipes.fetch_add(1, std::memory_order_relaxed);
+                wipedBytes.fetch_add(bytes, std::memory_order_relaxed);
+            }
+
+        private:
+            friend class SecureMetrics;
+            const char* type;
+            Counters* next;
+
+            explicit Counters(const char* name) : type(name), next(nullptr) {}
+        };
+
+        //Counters of SecuredPtr<T>, registered on first use
+        template <typename T>
+        static Counters& ForType()
+        {
+            static Counters* counters = Register(new Counters(typeid(T).name()));
+            return *counters;
+        }
+
+        //Times one event in everyN (rounded up to a power of 2) on each thread, 1 times them all
+        static void SetSampling(uint32_t everyN)
+        {
+            uint32_t mask = 1;
+            while (mask < everyN && mask < (1u << 31))
+                mask <<= 1;
+            SamplingMask().store(mask - 1, std::memory_order_relaxed);
+        }
+
+        //Whether the calling thread times this event
+        static bool Sample()
+        {
+            static thread_local uint32_t events = 0;
+            return (++events & SamplingMask().load(std::memory_order_relaxed)) == 0;
+        }
+
+        static uint64_t Now()
+        {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        //Current value of every counter, the totals are the sum of the types
+        static SecureMetricsSnapshot Snapshot()
+        {
+            SecureMetricsSnapshot snapshot{};
+#ifdef _SecuredMetrics
+            snapshot.enabled = true;
+#endif
+            snapshot.total.type = "*";
+            for (Counters* c = Head().load(std::memory_order_acquire); c != nullptr; c = c->next)
+            {
+                SecureTypeMetrics m{};
+                m.type = c->type;
+                m.allocations = c->allocations.load(std::memory_order_relaxed);
+                m.allocatedBytes = c->allocatedBytes.load(std::memory_order_relaxed);
+                m.wipes = c->wipes.load(std::memory_order_relaxed);
+                m.wipedBytes = c->wipedBytes.load(std::memory_order_relaxed);
+                m.encryptions = c->encryptions.load(std::memory_order_relaxed);
+                m.decryptions = c->decryptions.load(std::memory_order_relaxed);
+                c->encrypt.Load(m.encrypt);
+                c->decrypt.Load(m.decrypt);
+                c->lockWait.Load(m.lockWait);
+                c->exposure.Load(m.exposure);
+                snapshot.total.Add(m);
+                snapshot.types.push_back(m);
+            }
+            return snapshot;
+        }
+
+        //Snapshot as one JSON object, for scrapers and logs
+        static std::string ToJson(const SecureMetricsSnapshot& snapshot)
+        {
+            std::string json = snapshot.enabled ? "{\"enabled\":true,\"total\":" : "{\"enabled\":false,\"total\":";
+            AppendJson(json, snapshot.total);
+            json += ",\"types\":[";
+            for (size_t i = 0; i < snapshot.types.size(); i++)
+            {
+                if (i > 0)
+                    json += ',';
+                AppendJson(json, snapshot.types[i]);
+            }
+            json += "]}";
+            return json;
+        }
+
+    private:
+        static std::atomic<uint32_t>& SamplingMask()
+        {
+            static std::atomic<uint32_t> mask{ 15 };
+            return mask;
+        }
+
+        static std::atomic<Counters*>& Head()
+        {
+            static std::atomic<Counters*> head{ nullptr };
+            return head;
+        }
+
+        static Counters* Register(Counters* counters)
+        {
+            Counters* head = Head().load(std::memory_order_relaxed);
+            do
+                counters->next = head;
+            while (!Head().compare_exchange_weak(head, counters, std::memory_order_release, std::memory_order_relaxed));
+            return counters;
+        }
+
+        static void AppendJson(std::string& json, const SecureHistogram& h)
+        {
+            char text[64];
+            snprintf(text, sizeof(text), "{\"count\":%llu,\"total_ns\":%llu,\"buckets\":[",
+                (unsigned long long)h.count, (unsigned long long)h.totalNs);
+            json += text;
+            for (size_t i = 0; i < SecureHistogram::BucketCount; i++)
+            {
+                snprintf(text, sizeof(text), i > 0 ? ",%llu" : "%llu", (unsigned long long)h.buckets[i]);
+                json += text;
+            }
+            json += "]}";
+        }
+
+        static void AppendJson(std::string& json, const SecureTypeMetrics& m)
+        {
+            char text[160];
+            json += "{\"type\":\"";
+            for (const char* p = m.type; *p != '\0'; p++)
+            {
+                if (*p == '"' || *p == '\\')
+                    json += '\\';
+                json += *p;
+            }
+            snprintf(text, sizeof(text), "\",\"allocations\":%llu,\"allocated_bytes\":%llu,\"wipes\":%llu,\"wiped_bytes\":%llu",
+                (unsigned long long)m.allocations, (unsigned long long)m.allocatedBytes,
+                (unsigned long long)m.wipes, (unsigned long long)m.wipedBytes);
+            json += text;
+            snprintf(text, sizeof(text), ",\"encryptions\":%llu,\"decryptions\":%llu",
+                (unsigned long long)m.encryptions, (unsigned long long)m.decryptions);
+            json += text;
+            json += ",\"encrypt\":";
+            AppendJson(json, m.encrypt);
+            json += ",\"decrypt\":";
+            AppendJson(json, m.decrypt);
+            json += ",\"lock_wait\":";
+            AppendJson(json, m.lockWait);
+            json += ",\"exposure\":";
+            AppendJson(json, m.exposure);
+            json += '}';
+        }
+    };
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// Opt-in registry of the live SecuredPtr objects, compiled in by defining _SecuredRegistry for the whole program.
+// Every SecuredPtr, SecureVault and SecuredMap then links itself in one of the shards of the registry for its
+// lifetime, which lets process wide operations reach all the secrets:
+//   Rekey()   - rotates the key of a Rotatable backend and re-encrypts every secret under the new one,
+//               then retires the old key. Other backends (DPAPI, whose session key cannot change) only
+//               re-encrypt under a fresh nonce.
+//   WipeAll() - empties every SecuredPtr, vault and map and wipes the plaintext cache, for security events.
+// Both walk the shards on several threads. A shard is locked for one batch of objects at a time, so that
+// constructors and destructors are only held up for a batch and readers never wait more than the
+// re-encryption of the secret they read.
+
+#include "SecureCryptBackend.h"
+#include "SecureCache.h"
+#include "SecureSealer.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Secured_Ptr
+{
+    enum class SecureRegistryAction
+    {
+        Refresh, //Re-encrypt under the current key what an older key encrypted
+        Rekey,   //Re-encrypt everything
+        Wipe     //Drop the data
+    };
+
+    //Links of a registered object. With _SecuredRegistry SecuredPtr, SecureVault and SecuredMap derive from it.
+    struct SecureRegistryNode
+    {
+        SecureRegistryNode* prev = nullptr;
+        SecureRegistryNode* next = nullptr;
+        bool (*visit)(SecureRegistryNode* node, SecureRegistryAction action) = nullptr; //nullptr for list heads and walker cursors
+    };
+
+#ifdef _SecuredRegistry
+    typedef SecureRegistryNode SecureRegistryHook;
+#else
+    struct SecureRegistryHook {};
+#endif
+
+    struct SecureRegistryResult
+    {
+        size_t visited;   //Objects walked
+        size_t failed;    //Objects whose data could not be re-encrypted
+        bool rotated;     //Rekey() replaced the key and retired the previous one
+    };
+
+    class SecureRegistry
+    {
+    public:
+        //Never destroyed so that static SecuredPtr objects can unregister till exit
+        static SecureRegistry& Instance()
+        {
+            static SecureRegistry* registry = new SecureRegistry();
+            return *registry;
+        }
+
+        //Links node, visit(node, Refresh) runs under the lock of its shard so that no walk can miss the data
+        void Add(SecureRegistryNode* node, bool (*visit)(SecureRegistryNode*, SecureRegistryAction))
+        {
+            Shard& shard = GetShard(node);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            node->visit = visit;
+            LinkAfter(&shard.head, node);
+            shard.count++;
+            visit(node, SecureRegistryAction::Refresh);
+        }
+
+        //Unlinks node, waits for a walk visiting its shard to release it
+        void Remove(SecureRegistryNode* node)
+        {
+            Shard& shard = GetShard(node);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            Unlink(node);
+            shard.count--;
+        }
+
+        //Registered objects
+        static size_t Count()
+        {
+            size_t count = 0;
+            for (Shard& shard : Instance().shards)
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                count += shard.count;
+            }
+            return count;
+        }
+
+        //Re-encrypts every registered SecuredPtr, SecureVault and SecuredMap under a new key of Backend on threads
+        //threads (0: one per core), does nothing without _SecuredRegistry. The previous key is retired only when
+        //every secret could be re-encrypted, else the next call finishes. A vault or map busy during the walk
+        //counts as failed and keeps the previous key alive.
+        template <typename Backend = DefaultCryptBackend>
+        static SecureRegistryResult Rekey(size_t threads = 0)
+        {
+#ifndef _SecuredRegistry
+            //Nothing is registered, retiring the key would lose every secret
+            (void)threads;
+            return SecureRegistryResult{};
+#else
+            SecureRegistry& registry = Instance();
+            std::lock_guard<std::mutex> lock(registry.rotation);
+            if constexpr (IsRotatableBackend<Backend>::value)
+            {
+                //A rotation that could not retire its key is finished instead of starting a new one
+                bool rotated = Backend::RotateKey();
+                SecureRegistryResult result = registry.Walk(SecureRegistryAction::Refresh, threads);
+                if (result.failed == 0 && rotated)
+                {
+                    Backend::RetireKey();
+                    result.rotated = true;
+                }
+                return result;
+            }
+            else
+                return registry.Walk(SecureRegistryAction::Rekey, threads);
+#endif
+        }
+
+        //Empties every registered SecuredPtr, vault and map, wipes the cached plaintext and seals what the sealer holds.
+        //Does not wait for a running Rekey(). '&' handles still alive keep their copy till they are released.
+        static SecureRegistryResult WipeAll(size_t threads = 0)
+        {
+            SecureRegistryResult result = Instance().Walk(SecureRegistryAction::Wipe, threads);
+            SecurePlainCache::Clear();
+            SecureSealer::Instance().Flush();
+            return result;
+        }
+
+    private:
+        static constexpr size_t ShardCount = 64;
+        static constexpr size_t BatchSize = 32; //Objects visited per lock of a shard
+
+        struct alignas(64) Shard
+        {
+            std::mutex mutex;
+            SecureRegistryNode head; //Circular list
+            size_t count = 0;
+
+            Shard()
+            {
+                head.prev = &head;
+                head.next = &head;
+            }
+        };
+
+        Shard shards[ShardCount];
+        std::mutex rotation;
+
+        SecureRegistry() {}
+        SecureRegistry(const SecureRegistry&) = delete;
+        SecureRegistry& operator=(const SecureRegistry&) = delete;
+
+        Shard& GetShard(const SecureRegistryNode* node)
+        {
+            uint64_t h = (uint64_t)(uintptr_t)node * 0x9E3779B97F4A7C15ULL;
+            return shards[(size_t)(h >> 32) % ShardCount];
+        }
+
+        static void LinkAfter(SecureRegistryNode* position, SecureRegistryNode* node)
+        {
+            node->prev = position;
+            node->next = position->next;
+            position->next->prev = node;
+            position->next = node;
+        }
+
+        static void Unlink(SecureRegistryNode* node)
+        {
+            node->prev->next = node->next;
+            node->next->prev = node->prev;
+            node->prev = nullptr;
+            node->next = nullptr;
+        }
+
+        //Visits the shards on threads threads, the calling thread included
+        SecureRegistryResult Walk(SecureRegistryAction action, size_t threads)
+        {
+            if (threads == 0)
+                threads = std::thread::hardware_concurrency();
+            if (threads == 0)
+                threads = 1;
+            if (threads > ShardCount)
+                threads = ShardCount;
+            std::atomic<size_t> nextShard{ 0 };
+            std::atomic<size_t> visited{ 0 };
+            std::atomic<size_t> failed{ 0 };
+            auto worker = [&] {
+                for (size_t i = nextShard++; i < ShardCount; i = nextShard++)
+                    WalkShard(shards[i], action, visited, failed);
+            };
+            std::vector<std::thread> helpers;
+            for (size_t t = 1; t < threads; t++)
+            {
+                try
+                {
+                    helpers.emplace_back(worker);
+                }
+                catch (...)
+                {
+                    break;
+                }
+            }
+            worker();
+            for (std::thread& helper : helpers)
+                helper.join();
+            SecureRegistryResult result = {};
+            result.visited = visited.load();
+            result.failed = failed.load();
+            return result;
+        }
+
+        //A cursor node keeps the position in the shard while its lock is released between batches
+        void WalkShard(Shard& shard, SecureRegistryAction action, std::atomic<size_t>& visited, std::atomic<size_t>& failed)
+        {
+            SecureRegistryNode cursor;
+            std::unique_lock<std::mutex> lock(shard.mutex);
+            LinkAfter(&shard.head, &cursor);
+            for (;;)
+            {
+                for (size_t n = 0; n < BatchSize && cursor.next != &shard.head;)
+                {
+                    SecureRegistryNode* node = cursor.next;
+                    Unlink(&cursor);
+                    LinkAfter(node, &cursor);
+                    if (node->visit == nullptr)
+                        continue; //Cursor of a concurrent walk
+                    n++;
+                    visited++;
+                    if (!node->visit(node, action))
+                        failed++;
+                }
+                if (cursor.next == &shard.head)
+                    break;
+                //Lets waiting constructors and destructors in
+                lock.unlock();
+                lock.lock();
+            }
+            Unlink(&cursor);
+        }
+    };
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// Deferred re-encryption of SecuredPtr data.
+// A SecuredPtr with SetDeferredSeal(true) leaves its data decrypted when the last reader is done, so that
+// the next access costs no crypto call. The policy bounds how long and how often: the data is encrypted
+// again at most Window after the last reader left, or as soon as it was opened MaxAccesses times.
+// The SecureSealer thread keeps the deadlines in a timer wheel, scheduling is O(1) and the thread only
+// wakes up once per tick while something is pending.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Secured_Ptr
+{
+    class SecureSealer
+    {
+    public:
+        typedef void (*ExpireFunction)(void* item);
+
+        static SecureSealer& Instance()
+        {
+            static SecureSealer sealer;
+            return sealer;
+        }
+
+        //Process wide policy of the SecuredPtr with deferred sealing, applies to the data decrypted afterwards
+        static void SetPolicy(std::chrono::microseconds window, uint32_t maxAccesses)
+        {
+            Instance().SetPolicyImpl(window, maxAccesses);
+        }
+
+        static std::chrono::microseconds GetWindow()
+        {
+            return std::chrono::microseconds(Instance().window.load(std::memory_order_relaxed));
+        }
+
+        static uint32_t GetMaxAccesses()
+        {
+            return Instance().maxAccesses.load(std::memory_order_relaxed);
+        }
+
+        //Calls expire(item) on the sealer thread at most one window from now, false when the thread cannot run
+        bool Schedule(void* item, ExpireFunction expire)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (stopping || !StartThread())
+                return false;
+            //Due in (ticks - 1, ticks] ticks, one tick is kept for the wakeup latency of the thread
+            uint64_t ticks = (uint64_t)(window.load(std::memory_order_relaxed) / tickMicroseconds);
+            ticks = ticks > 1 ? ticks - 1 : 1;
+            size_t slot = (size_t)((cursor + ticks) % SlotCount);
+            slots[slot].push_back(Entry{ item, expire, (uint32_t)((ticks - 1) / SlotCount) });
+            if (pending++ == 0)
+                wakeup.notify_one();
+            return true;
+        }
+
+        //Expires everything pending now, on the calling thread
+        void Flush()
+        {
+            std::vector<Entry> due;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto& slot : slots)
+                {
+                    due.insert(due.end(), slot.begin(), slot.end());
+                    slot.clear();
+                }
+                pending = 0;
+            }
+            for (const Entry& entry : due)
+                entry.expire(entry.item);
+        }
+
+        //Items waiting for their deadline
+        size_t GetPending()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return pending;
+        }
+
+        ~SecureSealer()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeup.notify_one();
+            if (worker.joinable())
+                worker.join();
+            //Nothing may stay decrypted after exit
+            Flush();
+        }
+
+    private:
+        static constexpr size_t SlotCount = 256;
+        static constexpr uint64_t TicksPerWindow = 8; //Deadline resolution: an item expires in [6/8, 7/8] of the window plus the wakeup latency
+
+        struct Entry
+        {
+            void* item;
+            ExpireFunction expire;
+            uint32_t rounds; //Full turns of the wheel left before the deadline
+        };
+
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::thread worker;
+        bool stopping = false;
+        std::vector<Entry> slots[SlotCount];
+        uint64_t cursor = 0;
+        size_t pending = 0;
+        uint64_t tickMicroseconds = 125;
+        std::atomic<uint64_t> window{ 1000 };
+        std::atomic<uint32_t> maxAccesses{ 64 };
+
+        SecureSealer() {}
+        SecureSealer(const SecureSealer&) = delete;
+        SecureSealer& operator=(const SecureSealer&) = delete;
+
+        void SetPolicyImpl(std::chrono::microseconds newWindow, uint32_t newMaxAccesses)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            uint64_t micro = newWindow.count() > 0 ? (uint64_t)newWindow.count() : 1;
+            window.store(micro, std::memory_order_relaxed);
+            maxAccesses.store(newMaxAccesses > 0 ? newMaxAccesses : 1, std::memory_order_relaxed);
+            //Pending items keep their slot, a shorter tick only brings them forward
+            tickMicroseconds = micro / TicksPerWindow > 0 ? micro / TicksPerWindow : 1;
+        }
+
+        //Called with the mutex held
+        bool StartThread()
+        {
+            if (worker.joinable())
+                return true;
+            try
+            {
+                worker = std::thread(&SecureSealer::Run, this);
+            }
+            catch (...)
+            {
+                return false;
+            }
+            return true;
+        }
+
+        //Moves the entries of slot due at this turn of the wheel to due
+        static void ExpireSlot(std::vector<Entry>& slot, std::vector<Entry>& due)
+        {
+            for (size_t i = 0; i < slot.size();)
+            {
+                if (slot[i].rounds == 0)
+                {
+                    due.push_back(slot[i]);
+                    slot[i] = slot.back();
+                    slot.pop_back();
+                }
+                else
+                    slot[i++].rounds--;
+            }
+        }
+
+        void Run()
+        {
+            std::vector<Entry> due;
+            std::unique_lock<std::mutex> lock(mutex);
+            auto next = std::chrono::steady_clock::now();
+            while (!stopping)
+            {
+                if (pending == 0)
+                {
+                    wakeup.wait(lock, [this] { return stopping || pending > 0; });
+                    next = std::chrono::steady_clock::now();
+                    continue;
+                }
+                next += std::chrono::microseconds(tickMicroseconds);
+                wakeup.wait_until(lock, next, [this] { return stopping; });
+                if (stopping)
+                    break;
+
+                //Late ticks are caught up, every slot passed is expired
+                auto now = std::chrono::steady_clock::now();
+                for (;;)
+                {
+                    ExpireSlot(slots[++cursor % SlotCount], due);
+                    if (next + std::chrono::microseconds(tickMicroseconds) > now)
+                        break;
+                    next += std::chrono::microseconds(tickMicroseconds);
+                }
+                pending -= due.size();
+
+                lock.unlock();
+                for (const Entry& entry : due)
+                    entry.expire(entry.item);
+                due.clear();
+                lock.lock();
+            }
+        }
+    };
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// How SecuredPtr<T> turns a T into the bytes it encrypts and back.
+// SecureTraits<T> is a customization point, a specialization provides:
+//   FixedSize               - true when every T serializes to the constexpr Size bytes, GetSize() is then not used
+//   GetSize(obj)            - serialized size of obj in bytes
+//   Write(obj, dest, size)  - serializes obj straight into dest, the final encryption buffer
+//   Read(data, size)        - a T rebuilt from serialized data
+//   Data(obj)               - the serialized bytes when obj holds them contiguously, nullptr otherwise
+//   InPlace                 - the serialized bytes are a usable T: access() gives a T& and '&' aliases the buffer
+//   View, MakeView(data, size) - what access() exposes of the decrypted data
+//   ConstView, MakeConstView(data, size) - optional, the same for read-only access (caccess()), View by default
+// Built-in: std::basic_string (string, wstring, u16string, u32string), CString, std::vector of trivially copyable
+// elements, and every other type as its raw bytes (trivially copyable types, std::array of them, plain structs).
+// SecureMember<&S::member> gives where a member lies in the raw bytes of S for SecuredPtr::get()/set().
+
+#include "SecureCryptBackend.h"
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <type_traits>
+#include <memory>
+#ifdef _WIN32
+#include "atlstr.h"
+#endif
+
+namespace Secured_Ptr
+{
+#ifdef _WIN32
+    template <typename U> struct IsCString : std::is_same<U, CString> {};
+#else
+    template <typename U> struct IsCString : std::false_type {};
+#endif
+
+    //Contiguous elements seen through access(), the decrypted counterpart of a std::vector
+    template <typename U> class SecureSpan
+    {
+    public:
+        SecureSpan() : ptr(nullptr), count(0) {}
+        SecureSpan(U* data, size_t size) : ptr(data), count(size) {}
+        //A span of const elements can be made of any span
+        template <typename V, typename = typename std::enable_if<std::is_same<const V, U>::value>::type>
+        SecureSpan(const SecureSpan<V>& other) : ptr(other.data()), count(other.size()) {}
+
+        U* data() const { return ptr; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        U* begin() const { return ptr; }
+        U* end() const { return ptr + count; }
+        U& operator[](size_t i) const { return ptr[i]; }
+
+    private:
+        U* ptr;
+        size_t count;
+    };
+
+    //Class, type and byte offset of the data member Member
+    template <auto Member> struct SecureMember;
+    template <typename C, typename M, M C::* Member> struct SecureMember<Member>
+    {
+        typedef C Class;
+        typedef M Type;
+
+        //offsetof() for a member pointer, measured once on storage laid out like a C
+        static size_t Offset()
+        {
+            static const size_t offset = Measure();
+            return offset;
+        }
+
+    private:
+        static size_t Measure()
+        {
+            alignas(C) static unsigned char storage[sizeof(C)];
+            const C* obj = reinterpret_cast<const C*>(storage);
+            return (size_t)(reinterpret_cast<const unsigned char*>(std::addressof(obj->*Member)) - storage);
+        }
+    };
+
+    //Read-only view of Traits: its ConstView, or its View for specializations that do not declare one
+    template <typename Traits, typename = void> struct SecureConstView
+    {
+        static constexpr bool Declared = false;
+        typedef typename Traits::View Type;
+        static Type Make(const BYTE* data, size_t size) { return Traits::MakeView(const_cast<PBYTE>(data), size); }
+    };
+    template <typename Traits> struct SecureConstView<Traits, std::void_t<typename Traits::ConstView>>
+    {
+        static constexpr bool Declared = true;
+        typedef typename Traits::ConstView Type;
+        static Type Make(const BYTE* data, size_t size) { return Traits::MakeConstView(data, size); }
+    };
+
+    //Any other type is kept as its raw bytes, the legacy SecuredPtr behavior.
+    //Types owning memory elsewhere (pointers, containers) should get their own specialization.
+    template <typename T, typename Enable = void> struct SecureTraits
+    {
+        static constexpr bool FixedSize = true;
+        static constexpr size_t Size = sizeof(T);
+        static constexpr bool InPlace = true;
+        typedef T& View;
+        typedef const T& ConstView;
+
+        static size_t GetSize(const T&) { return Size; }
+        static void Write(const T& obj, PBYTE dest, size_t size) { memcpy(dest, &obj, size); }
+        static T Read(const BYTE* data, size_t) { return *reinterpret_cast<const T*>(data); }
+        static const void* Data(const T& obj) { return &obj; }
+        static View MakeView(PBYTE data, size_t) { return *reinterpret_cast<T*>(data); }
+        static ConstView MakeConstView(const BYTE* data, size_t) { return *reinterpret_cast<const T*>(data); }
+    };
+
+    //std::string, std::wstring, std::u16string, std::u32string: the characters without terminator
+    template <typename Char, typename CharTraits, typename Alloc>
+    struct SecureTraits<std::basic_string<Char, CharTraits, Alloc>>
+    {
+        typedef std::basic_string<Char, CharTraits, Alloc> String;
+        static constexpr bool FixedSize = false;
+        static constexpr size_t Size = 0;
+        static constexpr bool InPlace = false;
+        typedef std::basic_string_view<Char, CharTraits> View;
+        typedef View ConstView;
+
+        static size_t GetSize(const String& str) { return str.length() * sizeof(Char); }
+        static void Write(const String& str, PBYTE dest, size_t size) { memcpy(dest, str.data(), size); }
+        static String Read(const BYTE* data, size_t size) { return String(reinterpret_cast<const Char*>(data), size / sizeof(Char)); }
+        static const void* Data(const String& str) { return str.data(); }
+        static View MakeView(PBYTE data, size_t size) { return View(reinterpret_cast<const Char*>(data), size / sizeof(Char)); }
+        static ConstView MakeConstView(const BYTE* data, size_t size) { return View(reinterpret_cast<const Char*>(data), size / sizeof(Char)); }
+    };
+
+#ifdef _WIN32
+    template <> struct SecureTraits<CString>
+    {
+        static constexpr bool FixedSize = false;
+        static constexpr size_t Size = 0;
+        static constexpr bool InPlace = false;
+        typedef std::basic_string_view<wchar_t> View;
+        typedef View ConstView;
+
+        static size_t GetSize(const CString& str) { return str.GetLength() * sizeof(wchar_t); }
+        static void Write(const CString& str, PBYTE dest, size_t size) { memcpy(dest, str.GetString(), size); }
+        static CString Read(const BYTE* data, size_t size) { return CString(reinterpret_cast<const wchar_t*>(data), (int)(size / sizeof(wchar_t))); }
+        static const void* Data(const CString& str) { return str.GetString(); }
+        static View MakeView(PBYTE data, size_t size) { return View(reinterpret_cast<const wchar_t*>(data), size / sizeof(wchar_t)); }
+        static ConstView MakeConstView(const BYTE* data, size_t size) { return View(reinterpret_cast<const wchar_t*>(data), size / sizeof(wchar_t)); }
+    };
+#endif
+
+    //std::vector of trivially copyable elements: the elements one after the other
+    template <typename U, typename Alloc>
+    struct SecureTraits<std::vector<U, Alloc>, typename std::enable_if<std::is_trivially_copyable<U>::value && !std::is_same<U, bool>::value>::type>
+    {
+        typedef std::vector<U, Alloc> Vector;
+        static constexpr bool FixedSize = false;
+        static constexpr size_t Size = 0;
+        static constexpr bool InPlace = false;
+        typedef SecureSpan<U> View;
+        typedef SecureSpan<const U> ConstView;
+
+        static size_t GetSize(const Vector& v) { return v.size() * sizeof(U); }
+        static void Write(const Vector& v, PBYTE dest, size_t size) { memcpy(dest, v.data(), size); }
+        static Vector Read(const BYTE* data, size_t size)
+        {
+            Vector v(size / sizeof(U));
+            memcpy(v.data(), data, v.size() * sizeof(U));
+            return v;
+        }
+        static const void* Data(const Vector& v) { return v.data(); }
+        static View MakeView(PBYTE data, size_t size) { return View(reinterpret_cast<U*>(data), size / sizeof(U)); }
+        static ConstView MakeConstView(const BYTE* data, size_t size) { return ConstView(reinterpret_cast<const U*>(data), size / sizeof(U)); }
+    };
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+#include "SecuredPtr.h"
+#include <vector>
+#include <algorithm>
+#include <typeinfo>
+
+namespace Secured_Ptr
+{
+    //Many secrets packed in one contiguous encrypted region.
+    //Every secret is serialized through SecureTraits like SecuredPtr does and encrypted in its own block aligned slot,
+    //an index keeps the offset, size and type of each slot. One mutex and one allocation serve the
+    //whole vault and the bulk operations (Rekey, Wipe, Decrypt of a subset) walk the region in one pass.
+    //With _SecuredRegistry the vault is registered like SecuredPtr, so SecureRegistry::Rekey() and WipeAll() reach it.
+    template <typename Backend = DefaultCryptBackend, typename Allocator = DefaultSecureAllocator>
+    class SecureVault : private SecureRegistryHook
+    {
+    public:
+        static constexpr size_t InvalidId = (size_t)-1;
+
+        template <typename T>
+        using View = typename SecureTraits<T>::View;
+
+        explicit SecureVault(size_t initialCapacity = 4096)
+            : region(nullptr), capacity(0), used(0), reserved(initialCapacity > 0 ? initialCapacity : 4096)
+        {
+#ifdef _SecuredRegistry
+            SecureRegistry::Instance().Add(this, &RegistryVisit);
+#endif
+        }
+        SecureVault(const SecureVault&) = delete;
+        SecureVault& operator=(const SecureVault&) = delete;
+
+        ~SecureVault()
+        {
+#ifdef _SecuredRegistry
+            SecureRegistry::Instance().Remove(this);
+#endif
+            Wipe();
+            Allocator::Deallocate(region, capacity);
+        }
+
+        //Encrypts a copy of value into the vault and returns its id, InvalidId on failure
+        template <typename T>
+        size_t Add(const T& value)
+        {
+            size_t dataSize;
+            if constexpr (SecureTraits<T>::FixedSize)
+                dataSize = SecureTraits<T>::Size;
+            else
+                dataSize = SecureTraits<T>::GetSize(value);
+            if (dataSize == 0)
+                return InvalidId;
+
+            std::lock_guard<std::recursive_mutex> lg(m);
+            size_t dataBlockSize = Backend::GetBlockSize(dataSize);
+            if (!Reserve(used + dataBlockSize))
+                return InvalidId;
+
+            //Serialized straight into its slot
+            PBYTE slot = region + used;
+            SecureTraits<T>::Write(value, slot, dataSize);
+            memset(slot + dataSize, 0, dataBlockSize - dataSize);
+            if (!Backend::Protect(slot, dataBlockSize))
+            {
+                SecureZeroMemory(slot, dataBlockSize);
+                return InvalidId;
+            }
+
+            Entry entry = { used, dataSize, dataBlockSize, typeid(T).hash_code() };
+            index.push_back(entry);
+            used += dataBlockSize;
+            return index.size() - 1;
+        }
+
+        //Decrypted copy of one secret
+        template <typename T>
+        bool Get(size_t id, T& out)
+        {
+            std::lock_guard<std::recursive_mutex> lg(m);
+            if (id >= index.size() || index[id].typeHash != typeid(T).hash_code() || index[id].dataSize == 0)
+                return false;
+            const Entry& entry = index[id];
+            Unsealed unsealed(*this, &id);
+            if (!Backend::Unprotect(region + entry.offset, entry.dataBlockSize))
+                return false;
+            unsealed.count = 1;
+            out = SecureTraits<T>::Read(region + entry.offset, entry.dataSize);
+            return true;
+        }
+
+        //Decrypts the selected secrets in one pass, calls f(id, view) for each of them and
+        //re-encrypts them all before returning, also when f throws. View is SecureTraits<T>::View (string_view for
+        //strings, T& for raw types). Returns false without calling f when an id is unknown, holds another type
+        //or is given twice.
+        template <typename T, typename F>
+        bool Decrypt(const size_t* ids, size_t count, F&& f)
+        {
+            std::lock_guard<std::recursive_mutex> lg(m);
+            for (size_t i = 0; i < count; i++)
+            {
+                if (ids[i] >= index.size() || index[ids[i]].typeHash != typeid(T).hash_code() || index[ids[i]].dataSize == 0)
+                    return false;
+            }
+            //Decrypting a slot twice would encrypt it again
+            std::vector<size_t> sorted(ids, ids + count);
+            std::sort(sorted.begin(), sorted.end());
+            if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end())
+                return false;
+
+            Unsealed unsealed(*this, ids);
+            for (; unsealed.count < count; unsealed.count++)
+            {
+                const Entry& entry = index[ids[unsealed.count]];
+                if (!Backend::Unprotect(region + entry.offset, entry.dataBlockSize))
+                    return false;
+            }
+            for (size_t i = 0; i < count; i++)
+                f(ids[i], GetView<T>(index[ids[i]]));
+            return true;
+        }
+
+        //Re-encrypts every secret under a fresh nonce, returns false when a secret could not be re-encrypted
+        bool Rekey()
+        {
+            std::lock_guard<std::recursive_mutex> lg(m);
+            return RekeySlots(false);
+        }
+
+        //Overwrites the whole region and forgets every secret, the capacity is kept
+        void Wipe()
+        {
+            std::lock_guard<std::recursive_mutex> lg(m);
+            if (region != nullptr)
+                SecureZeroMemory(region, capacity);
+            index.clear();
+            used = 0;
+        }
+
+        size_t Count()
+        {
+            std::lock_guard<std::recursive_mutex> lg(m);
+            return index.size();
+        }
+
+        //Encrypted bytes held, padding and nonce blocks included
+        size_t GetSize()
+        {
+            std::lock_guard<std::recursive_mutex> lg(m);
+            return used;
+        }
+
+    private:
+        struct Entry
+        {
+            size_t offset;
+            size_t dataSize;
+            size_t dataBlockSize;
+            size_t typeHash;
+        };
+
+        //Encrypts the first count slots of ids again when it goes out of scope, a slot that cannot be
+        //encrypted is wiped
+        class Unsealed
+        {
+        public:
+            Unsealed(SecureVault& vault, const size_t* ids) : count(0), vault(vault), ids(ids) {}
+            ~Unsealed()
+            {
+                for (size_t i = 0; i < count; i++)
+                {
+                    const Entry& entry = vault.index[ids[i]];
+                    PBYTE slot = vault.region + entry.offset;
+                    if (!Backend::Protect(slot, entry.dataBlockSize))
+                        SecureZeroMemory(slot, entry.dataBlockSize);
+                }
+            }
+            Unsealed(const Unsealed&) = delete;
+            Unsealed& operator=(const Unsealed&) = delete;
+
+            size_t count; //Slots decrypted so far
+
+        private:
+            SecureVault& vault;
+            const size_t* ids;
+        };
+
+        std::recursive_mutex m;
+        PBYTE region;
+        size_t capacity;
+        size_t used;
+        size_t reserved;
+        std::vector<Entry> index;
+
+        //The slots are address independent so growing only moves the ciphertext
+        bool Reserve(size_t size)
+        {
+            if (size <= capacity)
+                return true;
+            size_t newCapacity = capacity ? capacity : reserved;
+            while (newCapacity < size)
+                newCapacity *= 2;
+            PBYTE newRegion = Allocator::Allocate(newCapacity);
+            if (newRegion == nullptr)
+                return false;
+            if (region != nullptr)
+            {
+                memcpy(newRegion, region, used);
+                Allocator::Deallocate(region, capacity);
+            }
+            region = newRegion;
+            capacity = newCapacity;
+            return true;
+        }
+
+        //Called with m held: re-encrypts the slots, with staleOnly only those a rotatable backend encrypted under
+        //an older key. A slot that cannot be re-encrypted is wiped.
+        bool RekeySlots(bool staleOnly)
+        {
+            bool result = true;
+            for (const Entry& entry : index)
+            {
+                if (entry.dataSize == 0)
+                    continue;
+                PBYTE slot = region + entry.offset;
+                if constexpr (IsRotatableBackend<Backend>::value)
+                {
+                    if (staleOnly && Backend::IsCurrentKey(slot, entry.dataBlockSize))
+                        continue;
+                }
+                if (!Backend::Unprotect(slot, entry.dataBlockSize) || !Backend::Protect(slot, entry.dataBlockSize))
+                {
+                    SecureZeroMemory(slot, entry.dataBlockSize);
+                    result = false;
+                }
+            }
+            return result;
+        }
+
+#ifdef _SecuredRegistry
+        //Runs action for SecureRegistry on the vault of node. The lock is only tried: its holder may be waiting
+        //for the shard the walk holds (a SecuredPtr made in a Decrypt() callback), the vault then counts as
+        //failed and the key is retired by a later Rekey().
+        static bool RegistryVisit(SecureRegistryNode* node, SecureRegistryAction action)
+        {
+            SecureVault* self = static_cast<SecureVault*>(node);
+            std::unique_lock<std::recursive_mutex> lock(self->m, std::try_to_lock);
+            if (!lock.owns_lock())
+                return false;
+            if (action == SecureRegistryAction::Wipe)
+            {
+                self->Wipe();
+                return true;
+            }
+            return self->RekeySlots(action == SecureRegistryAction::Refresh);
+        }
+#endif
+
+        template <typename T>
+        View<T> GetView(const Entry& entry)
+        {
+            return SecureTraits<T>::MakeView(region + entry.offset, entry.dataSize);
+        }
+    };
+}
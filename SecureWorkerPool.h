@@ -0,0 +1,185 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+// Bounded pool of threads running the crypto of large SecuredPtr values for async_access() and async_assign(),
+// so that the calling thread (an event loop) never encrypts or decrypts megabytes inline.
+// With a Seekable backend a large buffer is cut in chunks that the worker running the task and the idle
+// workers process side by side. The threads are started on first use, values smaller than GetMinAsyncSize()
+// stay on the synchronous path.
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Secured_Ptr
+{
+    class SecureWorkerPool
+    {
+    public:
+        static SecureWorkerPool& Instance()
+        {
+            static SecureWorkerPool pool;
+            return pool;
+        }
+
+        //threads: most workers ever started (0: one per core, at most 8), minAsyncSize: smaller values are
+        //processed by the caller, chunkSize: bytes of a buffer processed per task. Running workers are kept.
+        static void SetPolicy(size_t threads, size_t minAsyncSize, size_t chunkSize)
+        {
+            SecureWorkerPool& pool = Instance();
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            pool.maxThreads = threads > 0 ? threads : DefaultThreads();
+            pool.minAsyncSize.store(minAsyncSize, std::memory_order_relaxed);
+            pool.chunkSize.store(chunkSize > 0 ? chunkSize : 1, std::memory_order_relaxed);
+        }
+
+        static size_t GetMinAsyncSize()
+        {
+            return Instance().minAsyncSize.load(std::memory_order_relaxed);
+        }
+
+        static size_t GetChunkSize()
+        {
+            return Instance().chunkSize.load(std::memory_order_relaxed);
+        }
+
+        //Runs task on a worker, false when no worker could be started
+        bool Submit(std::function<void()> task)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping || !StartWorker())
+                return false;
+            queue.push_back(std::move(task));
+            wakeup.notify_one();
+            return true;
+        }
+
+        //Calls process(offset, length) on consecutive chunks of [0, size), on the calling thread and on the idle
+        //workers, and returns whether every call returned true. The caller takes chunks too, so this never waits
+        //for a busy pool.
+        template <typename Process>
+        bool ParallelFor(size_t size, Process&& process)
+        {
+            size_t chunk = GetChunkSize();
+            size_t chunks = (size + chunk - 1) / chunk;
+            if (chunks <= 1)
+                return size == 0 || process((size_t)0, size);
+
+            struct Job
+            {
+                std::atomic<size_t> next{ 0 };
+                std::atomic<size_t> done{ 0 };
+                std::atomic<bool> ok{ true };
+                std::mutex mutex;
+                std::condition_variable finished;
+            };
+            auto job = std::make_shared<Job>();
+            //Helpers only hold job, process is used while chunks are left, which the caller waits for
+            auto run = [job, chunk, chunks, size, &process] {
+                for (size_t i = job->next++; i < chunks; i = job->next++)
+                {
+                    size_t offset = i * chunk;
+                    if (!process(offset, offset + chunk < size ? chunk : size - offset))
+                        job->ok = false;
+                    if (++job->done == chunks)
+                    {
+                        std::lock_guard<std::mutex> lock(job->mutex);
+                        job->finished.notify_all();
+                    }
+                }
+            };
+            size_t helpers = chunks - 1;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (helpers > maxThreads)
+                    helpers = maxThreads;
+                for (size_t h = 0; h < helpers && !stopping && StartWorker(); h++)
+                    queue.push_back(run);
+            }
+            wakeup.notify_all();
+            run();
+            std::unique_lock<std::mutex> lock(job->mutex);
+            job->finished.wait(lock, [&job, chunks] { return job->done.load() == chunks; });
+            return job->ok.load();
+        }
+
+        //Finishes the queued tasks, then stops the workers
+        ~SecureWorkerPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeup.notify_all();
+            for (std::thread& worker : workers)
+                worker.join();
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        std::deque<std::function<void()>> queue;
+        std::vector<std::thread> workers;
+        size_t idle = 0;
+        size_t maxThreads = DefaultThreads();
+        bool stopping = false;
+        std::atomic<size_t> minAsyncSize{ 64 * 1024 };
+        std::atomic<size_t> chunkSize{ 256 * 1024 };
+
+        SecureWorkerPool() {}
+        SecureWorkerPool(const SecureWorkerPool&) = delete;
+        SecureWorkerPool& operator=(const SecureWorkerPool&) = delete;
+
+        static size_t DefaultThreads()
+        {
+            size_t cores = std::thread::hardware_concurrency();
+            return cores == 0 ? 1 : (cores > 8 ? 8 : cores);
+        }
+
+        //Called with the mutex held before a task is queued: starts a worker unless an idle one will take it
+        bool StartWorker()
+        {
+            if (idle > queue.size() || workers.size() >= maxThreads)
+                return !workers.empty();
+            try
+            {
+                workers.emplace_back(&SecureWorkerPool::Run, this);
+            }
+            catch (...)
+            {
+                return !workers.empty();
+            }
+            return true;
+        }
+
+        void Run()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                idle++;
+                wakeup.wait(lock, [this] { return stopping || !queue.empty(); });
+                idle--;
+                if (queue.empty())
+                    return;
+                std::function<void()> task = std::move(queue.front());
+                queue.pop_front();
+                lock.unlock();
+                task();
+                lock.lock();
+            }
+        }
+    };
+}
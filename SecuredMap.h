@@ -0,0 +1,556 @@
+#pragma once
+
+//*******************************************************************-
+//		|         |            	|
+// 	Version |  Date   | Author	| comment about the modification
+//*******************************************************************-
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//*******************************************************************-
+/////////////////////////////////////////////////////////////////////////////
+
+#include "SecuredPtr.h"
+#include <vector>
+
+namespace Secured_Ptr
+{
+    //Encrypted key-value store: keys and values are serialized through SecureTraits like SecuredPtr does,
+    //each key sealed with its value in one block aligned slot of a contiguous region.
+    //The index is an open addressing table (linear probing, no tombstones) of keyed fingerprints of the keys
+    //(SipHash under the process key of SecureFingerprint.h), so no key is kept in clear and the table cannot be
+    //flooded with chosen collisions. A lookup decrypts the slots of the matching fingerprints only, in practice
+    //the one holding the key, and compares the key in constant time. With a seekable backend reads decrypt a
+    //copy of the key and the value into a scratch buffer from Allocator and the slot itself stays sealed.
+    //Slots left by Erase() or by a value changing size are reused once they make up half of the region.
+    //With _SecuredRegistry the map is registered like SecuredPtr, so SecureRegistry::Rekey() and WipeAll() reach it.
+    template <typename K, typename V, typename Backend = DefaultCryptBackend, typename Allocator = DefaultSecureAllocator>
+    class SecuredMap : private SecureRegistryHook
+    {
+    public:
+        typedef typename SecureTraits<V>::View View;
+
+        explicit SecuredMap(size_t initialCapacity = 16)
+            : region(nullptr), capacity(0), used(0), garbage(0), count(0), scratch(nullptr), scratchSize(0), inCallback(false)
+        {
+            size_t slots = 16;
+            while (slots * 3 / 4 < initialCapacity)
+                slots *= 2;
+            table.resize(slots);
+#ifdef _SecuredRegistry
+            SecureRegistry::Instance().Add(this, &RegistryVisit);
+#endif
+        }
+        SecuredMap(const SecuredMap&) = delete;
+        SecuredMap& operator=(const SecuredMap&) = delete;
+
+        ~SecuredMap()
+        {
+#ifdef _SecuredRegistry
+            SecureRegistry::Instance().Remove(this);
+#endif
+            Clear();
+            Allocator::Deallocate(region, capacity);
+            Allocator::Deallocate(scratch, scratchSize);
+        }
+
+        //Adds key with value or replaces its value, false when it could not be encrypted (the map is then unchanged)
+        bool Insert(const K& key, const V& value)
+        {
+            KeyBytes k(key);
+            if (!k.Valid())
+                return false;
+            size_t valueSize = SizeOf<V>(value);
+            std::lock_guard<std::recursive_mutex> lg(m);
+            if (inCallback)
+                return false;
+            size_t pos = Find(k);
+            if (pos != NotFound && table[pos].valueSize == valueSize)
+            {
+                //Same size: rewritten in its slot
+                Entry& entry = table[pos];
+                PBYTE slot = region + entry.offset;
+                size_t slotSize = SlotSize(entry.keySize, valueSize);
+                if (!Backend::Unprotect(slot, slotSize))
+                    return false;
+                Plaintext sealed(slot, slotSize, true);
+                SecureTraits<V>::Write(value, slot + KeySpace(entry.keySize), valueSize);
+                return sealed.Close();
+            }
+
+            if (pos == NotFound && (count + 1) > table.size() * 3 / 4)
+                GrowTable();
+            size_t slotSize = SlotSize(k.size, valueSize);
+            if (!Reserve(slotSize))
+                return false;
+            PBYTE slot = region + used;
+            Plaintext sealed(slot, slotSize, true);
+            memcpy(slot, k.data, k.size);
+            memset(slot + k.size, 0, KeySpace(k.size) - k.size);
+            SecureTraits<V>::Write(value, slot + KeySpace(k.size), valueSize);
+            size_t dataSize = KeySpace(k.size) + valueSize;
+            memset(slot + dataSize, 0, slotSize - dataSize);
+            if (!sealed.Close())
+                return false;
+
+            Entry entry = { k.hash, used, k.size, valueSize };
+            used += slotSize;
+            if (pos != NotFound)
+            {
+                //Grown or shrunk: the old slot is left for the next compaction
+                Discard(table[pos]);
+                table[pos] = entry;
+            }
+            else
+            {
+                table[FreePosition(k.hash)] = entry;
+                count++;
+            }
+            return true;
+        }
+
+        //Decrypted copy of the value of key, false when key is missing or could not be decrypted
+        bool Get(const K& key, V& out)
+        {
+            return Access<false>(key, [&out](PBYTE data, size_t size) { out = SecureTraits<V>::Read(data, size); });
+        }
+
+        //Decrypts the value of key in place, calls f(view) and re-encrypts it, also when f throws. View is
+        //SecureTraits<V>::View, changes made through a T& view are kept. False without calling f when key is missing.
+        //f must not use the map: the calls it makes fail.
+        template <typename F>
+        bool Visit(const K& key, F&& f)
+        {
+            return Access<true>(key, [&f](PBYTE data, size_t size) { f(SecureTraits<V>::MakeView(data, size)); });
+        }
+
+        bool Contains(const K& key)
+        {
+            KeyBytes k(key);
+            if (!k.Valid())
+                return false;
+            std::lock_guard<std::recursive_mutex> lg(m);
+            return !inCallback && Find(k) != NotFound;
+        }
+
+        //Removes key, its slot is wiped at once
+        bool Erase(const K& key)
+        {
+            KeyBytes k(key);
+            if (!k.Valid())
+                return false;
+            std::lock_guard<std::recursive_mutex> lg(m);
+            if (inCallback)
+                return false;
+            size_t pos = Find(k);
+            if (pos == NotFound)
+                return false;
+            Discard(table[pos]);
+            RemoveAt(pos);
+            if (--count == 0)
+            {
+                used = 0;
+                garbage = 0;
+            }
+            return true;
+        }
+
+        //Re-encrypts every slot under a fresh nonce, false when a slot could not be re-encrypted (it is then wiped)
+        bool Rekey()
+        {
+            std::lock_guard<std::recursive_mutex> lg(m);
+            return !inCallback && RekeySlots(false);
+        }
+
+        //Overwrites the whole region and forgets every key, the capacity is kept
+        void Clear()
+        {
+            std::lock_guard<std::recursive_mutex> lg(m);
+            if (inCallback)
+                return;
+            if (region != nullptr)
+                SecureZeroMemory(region, capacity);
+            for (Entry& entry : table)
+                entry = Entry{};
+            used = 0;
+            garbage = 0;
+            count = 0;
+        }
+
+        size_t Count()
+        {
+            std::lock_guard<std::recursive_mutex> lg(m);
+            return count;
+        }
+
+        //Encrypted bytes held, slots waiting for compaction included
+        size_t GetSize()
+        {
+            std::lock_guard<std::recursive_mutex> lg(m);
+            return used;
+        }
+
+    private:
+        static constexpr size_t NotFound = (size_t)-1;
+
+        struct Entry
+        {
+            uint64_t hash;   //Keyed fingerprint of the key, 0 for a free position
+            size_t offset;
+            size_t keySize;
+            size_t valueSize;
+        };
+
+        //Serialized key and its fingerprint, serialized into a buffer from Allocator when it is not contiguous
+        struct KeyBytes
+        {
+            const BYTE* data;
+            size_t size;
+            uint64_t hash;
+            PBYTE buffer;
+
+            explicit KeyBytes(const K& key) : data(nullptr), size(SizeOf<K>(key)), hash(0), buffer(nullptr)
+            {
+                data = static_cast<const BYTE*>(SecureTraits<K>::Data(key));
+                if (data == nullptr && size > 0)
+                {
+                    buffer = Allocator::Allocate(size);
+                    if (buffer != nullptr)
+                        SecureTraits<K>::Write(key, buffer, size);
+                    data = buffer;
+                }
+                static const BYTE none = 0;
+                if (size == 0)
+                    data = &none;
+                if (data != nullptr)
+                    hash = SecureFingerprint::Compute(data, size);
+            }
+            ~KeyBytes()
+            {
+                Allocator::Deallocate(buffer, size);
+            }
+            KeyBytes(const KeyBytes&) = delete;
+            KeyBytes& operator=(const KeyBytes&) = delete;
+
+            //0 when the process key of the fingerprints is missing
+            bool Valid() const { return hash != 0; }
+        };
+
+        std::recursive_mutex m;
+        PBYTE region;
+        size_t capacity;
+        size_t used;
+        size_t garbage; //Bytes of the slots no entry points to
+        size_t count;
+        std::vector<Entry> table; //Power of two positions, at most 3/4 used
+        PBYTE scratch;            //Plaintext copies of a slot with a seekable backend, wiped after each use
+        size_t scratchSize;
+        bool inCallback;          //The callback of Access() runs, the calls it makes into the map are refused
+                                  //since a Reserve() would move the slot it is given
+
+        //Plaintext of a slot, decrypted in place (encrypted again) or copied into scratch (wiped) when it goes out
+        //of scope, also when a callback throws
+        class Plaintext
+        {
+        public:
+            Plaintext(PBYTE data, size_t size, bool inPlace) : data(data), size(size), inPlace(inPlace) {}
+            ~Plaintext()
+            {
+                Close();
+            }
+            Plaintext(const Plaintext&) = delete;
+            Plaintext& operator=(const Plaintext&) = delete;
+
+            //False when the slot could not be encrypted again, it is then wiped
+            bool Close()
+            {
+                if (data == nullptr)
+                    return true;
+                bool result = true;
+                if (inPlace)
+                    result = Seal(data, size);
+                else
+                    SecureZeroMemory(data, size);
+                data = nullptr;
+                return result;
+            }
+
+        private:
+            PBYTE data;
+            size_t size;
+            bool inPlace;
+        };
+
+        //Marks the map as running a callback of Access() till it goes out of scope
+        class CallbackScope
+        {
+        public:
+            explicit CallbackScope(bool& flag) : flag(flag) { flag = true; }
+            ~CallbackScope() { flag = false; }
+            CallbackScope(const CallbackScope&) = delete;
+            CallbackScope& operator=(const CallbackScope&) = delete;
+
+        private:
+            bool& flag;
+        };
+
+        template <typename T>
+        static size_t SizeOf(const T& obj)
+        {
+            if constexpr (SecureTraits<T>::FixedSize)
+                return SecureTraits<T>::Size;
+            else
+                return SecureTraits<T>::GetSize(obj);
+        }
+
+        //The value starts on the next 16 bytes after the key so that it is aligned for T& views
+        static size_t KeySpace(size_t keySize)
+        {
+            return (keySize + 15) & ~(size_t)15;
+        }
+
+        static size_t SlotSize(size_t keySize, size_t valueSize)
+        {
+            size_t dataSize = KeySpace(keySize) + valueSize;
+            return Backend::GetBlockSize(dataSize > 0 ? dataSize : 1);
+        }
+
+        static bool Seal(PBYTE slot, size_t slotSize)
+        {
+            if (Backend::Protect(slot, slotSize))
+                return true;
+            SecureZeroMemory(slot, slotSize);
+            return false;
+        }
+
+        //Called with m held: re-encrypts the slots, with staleOnly only those a rotatable backend encrypted under
+        //an older key. A slot that cannot be re-encrypted is wiped.
+        bool RekeySlots(bool staleOnly)
+        {
+            bool result = true;
+            for (const Entry& entry : table)
+            {
+                if (entry.hash == 0)
+                    continue;
+                PBYTE slot = region + entry.offset;
+                size_t slotSize = SlotSize(entry.keySize, entry.valueSize);
+                if constexpr (IsRotatableBackend<Backend>::value)
+                {
+                    if (staleOnly && Backend::IsCurrentKey(slot, slotSize))
+                        continue;
+                }
+                if (!Backend::Unprotect(slot, slotSize) || !Backend::Protect(slot, slotSize))
+                {
+                    SecureZeroMemory(slot, slotSize);
+                    result = false;
+                }
+            }
+            return result;
+        }
+
+#ifdef _SecuredRegistry
+        //Runs action for SecureRegistry on the map of node. The lock is only tried: its holder may be waiting for
+        //the shard the walk holds (a SecuredPtr made in a Visit() callback), the map then counts as failed and the
+        //key is retired by a later Rekey(). A map running a callback on this thread is skipped the same way.
+        static bool RegistryVisit(SecureRegistryNode* node, SecureRegistryAction action)
+        {
+            SecuredMap* self = static_cast<SecuredMap*>(node);
+            std::unique_lock<std::recursive_mutex> lock(self->m, std::try_to_lock);
+            if (!lock.owns_lock() || self->inCallback)
+                return false;
+            if (action == SecureRegistryAction::Wipe)
+            {
+                self->Clear();
+                return true;
+            }
+            return self->RekeySlots(action == SecureRegistryAction::Refresh);
+        }
+#endif
+
+        //Calls f(value, valueSize) on the decrypted value of key. Writable decrypts the slot in place and
+        //re-encrypts it afterwards, otherwise a seekable backend decrypts a copy. f cannot re-enter the map.
+        template <bool Writable, typename F>
+        bool Access(const K& key, F&& f)
+        {
+            KeyBytes k(key);
+            if (!k.Valid())
+                return false;
+            std::lock_guard<std::recursive_mutex> lg(m);
+            if (inCallback)
+                return false;
+            PBYTE plain = nullptr;
+            size_t pos = Find(k, !Writable && IsSeekableBackend<Backend>::value ? &plain : nullptr);
+            if (pos == NotFound)
+                return false;
+            const Entry& entry = table[pos];
+            size_t valueOffset = KeySpace(entry.keySize);
+            size_t valueSize = entry.valueSize;
+            if (plain != nullptr)
+            {
+                Plaintext wiped(plain, valueOffset + valueSize, false);
+                CallbackScope callback(inCallback);
+                f(plain + valueOffset, valueSize);
+                return true;
+            }
+            PBYTE slot = region + entry.offset;
+            size_t slotSize = SlotSize(entry.keySize, valueSize);
+            if (!Backend::Unprotect(slot, slotSize))
+                return false;
+            Plaintext sealed(slot, slotSize, true);
+            CallbackScope callback(inCallback);
+            f(slot + valueOffset, valueSize);
+            return true;
+        }
+
+        //Position of key in the table, NotFound when it is missing.
+        //With plain (seekable backends) the key and the value of the entry found are decrypted together into
+        //scratch in one call, *plain points to them and the caller wipes them.
+        size_t Find(const KeyBytes& k, PBYTE* plain = nullptr)
+        {
+            size_t mask = table.size() - 1;
+            for (size_t i = k.hash & mask; table[i].hash != 0; i = (i + 1) & mask)
+            {
+                const Entry& entry = table[i];
+                if (entry.hash != k.hash || entry.keySize != k.size)
+                    continue;
+                bool match;
+                if constexpr (IsSeekableBackend<Backend>::value)
+                {
+                    size_t len = plain != nullptr ? KeySpace(entry.keySize) + entry.valueSize : k.size;
+                    PBYTE stored = OpenCopy(entry, len);
+                    if (stored == nullptr)
+                        continue;
+                    match = SecureCompare::Equal(stored, k.data, k.size);
+                    if (match && plain != nullptr)
+                        *plain = stored;
+                    else
+                        SecureZeroMemory(stored, len);
+                }
+                else
+                {
+                    PBYTE slot = region + entry.offset;
+                    size_t slotSize = SlotSize(entry.keySize, entry.valueSize);
+                    if (!Backend::Unprotect(slot, slotSize))
+                        continue;
+                    match = SecureCompare::Equal(slot, k.data, k.size);
+                    Seal(slot, slotSize);
+                }
+                if (match)
+                    return i;
+            }
+            return NotFound;
+        }
+
+        //Plaintext of the first len bytes of the slot of entry, decrypted into scratch (seekable backends only).
+        //The caller wipes it.
+        PBYTE OpenCopy(const Entry& entry, size_t len)
+        {
+            if constexpr (IsSeekableBackend<Backend>::value)
+            {
+                if (len > scratchSize || scratch == nullptr)
+                {
+                    size_t size = scratchSize > 0 ? scratchSize : 256;
+                    while (size < len)
+                        size *= 2;
+                    PBYTE buffer = Allocator::Allocate(size);
+                    if (buffer == nullptr)
+                        return nullptr;
+                    Allocator::Deallocate(scratch, scratchSize);
+                    scratch = buffer;
+                    scratchSize = size;
+                }
+                PBYTE slot = region + entry.offset;
+                size_t slotSize = SlotSize(entry.keySize, entry.valueSize);
+                memcpy(scratch, slot, len);
+                if (Backend::CryptRange(Backend::GetNonce(slot, slotSize), 0, scratch, len))
+                    return scratch;
+                SecureZeroMemory(scratch, len);
+            }
+            (void)entry; (void)len;
+            return nullptr;
+        }
+
+        //First free position on the probe sequence of hash
+        size_t FreePosition(uint64_t hash)
+        {
+            size_t mask = table.size() - 1;
+            size_t i = hash & mask;
+            while (table[i].hash != 0)
+                i = (i + 1) & mask;
+            return i;
+        }
+
+        //Frees position pos and moves back the entries that probed past it, so that lookups never need tombstones
+        void RemoveAt(size_t pos)
+        {
+            size_t mask = table.size() - 1;
+            size_t i = pos;
+            for (size_t j = (pos + 1) & mask; table[j].hash != 0; j = (j + 1) & mask)
+            {
+                size_t home = table[j].hash & mask;
+                if (((j - home) & mask) >= ((j - i) & mask))
+                {
+                    table[i] = table[j];
+                    i = j;
+                }
+            }
+            table[i] = Entry{};
+        }
+
+        //Twice the positions, the fingerprints are kept so no slot is decrypted
+        void GrowTable()
+        {
+            std::vector<Entry> old(table.size() * 2);
+            old.swap(table);
+            for (const Entry& entry : old)
+            {
+                if (entry.hash != 0)
+                    table[FreePosition(entry.hash)] = entry;
+            }
+        }
+
+        //Wipes the slot of entry, its bytes are counted for the next compaction
+        void Discard(const Entry& entry)
+        {
+            size_t slotSize = SlotSize(entry.keySize, entry.valueSize);
+            SecureZeroMemory(region + entry.offset, slotSize);
+            garbage += slotSize;
+        }
+
+        //Room for size more bytes at the end of the region. The slots are address independent, so growing and
+        //compacting only move ciphertext. Compacting waits for half of the region to be garbage, which keeps
+        //its cost to a copy per byte freed.
+        bool Reserve(size_t size)
+        {
+            if (used + size <= capacity)
+                return true;
+            bool compact = garbage >= used / 2;
+            size_t needed = (compact ? used - garbage : used) + size;
+            size_t newCapacity = capacity ? capacity : 4096;
+            while (newCapacity < needed)
+                newCapacity *= 2;
+            PBYTE newRegion = Allocator::Allocate(newCapacity);
+            if (newRegion == nullptr)
+                return false;
+            if (compact)
+            {
+                size_t offset = 0;
+                for (Entry& entry : table)
+                {
+                    if (entry.hash == 0)
+                        continue;
+                    size_t slotSize = SlotSize(entry.keySize, entry.valueSize);
+                    memcpy(newRegion + offset, region + entry.offset, slotSize);
+                    entry.offset = offset;
+                    offset += slotSize;
+                }
+                used = offset;
+                garbage = 0;
+            }
+            else if (region != nullptr)
+                memcpy(newRegion, region, used);
+            Allocator::Deallocate(region, capacity);
+            region = newRegion;
+            capacity = newCapacity;
+            return true;
+        }
+    };
+}
@@ -4,20 +4,36 @@
 //		|         |            	|
 // 	Version |  Date   | Author	| comment about the modification
 //*******************************************************************-
-*   	1.0     |03/07/22 | C.GHOSH  	 | Creation
+//   	1.0     |03/07/22 | C.GHOSH  	 | Creation
 //*******************************************************************-
 /////////////////////////////////////////////////////////////////////////////
 
-#include "Windows.h"
-#include "Wincrypt.h"
+#include "SecureCryptBackend.h"
+#include "SecureArena.h"
+#include "SecureCompare.h"
+#include "SecureFingerprint.h"
+#include "SecureTraits.h"
+#include "SecureSealer.h"
+#include "SecureCache.h"
+#include "SecureMetrics.h"
+#include "SecureRegistry.h"
+#include "SecureExpiry.h"
+#include "SecureWorkerPool.h"
 #include <string>
 #include <memory>
 #include <iostream>
 #include <type_traits>
-#include <mutex>
-#include "atlstr.h"
-
-#pragma comment(lib, "crypt32.lib")
+#include <atomic>
+#include <thread>
+#include <future>
+#include <string_view>
+#include <cerrno>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -29,210 +45,1271 @@ using namespace std;
 
 namespace Secured_Ptr
 {
+    //Keystream position of the data streamed by SecuredPtr::ReadFrom(), encrypting chunk by chunk.
+    //Without a seekable backend the chunks are kept as they are and encrypted at the end.
+    template <typename Backend> struct StreamNonce
+    {
+        typename Backend::Nonce value;
 
-    template <typename T>
-    class SecuredPtr
+        bool Init() { return Backend::NewNonce(value); }
+        bool Crypt(size_t offset, PBYTE chunk, size_t len) { return Backend::CryptRange(value, offset, chunk, len); }
+    };
+
+    template <> struct StreamNonce<void>
     {
-    private:
-        std::recursive_mutex m;
+        bool Init() { return true; }
+        bool Crypt(size_t, PBYTE, size_t) { return true; }
+    };
+
+    //Header of the protected buffer, the encrypted data follows it.
+    //A block is immutable once sealed and shared by all the copies of a SecuredPtr: refs counts the owners
+    //and the readers pinning it. state holds the phase of the data in the two low bits and the number of
+    //readers above them, readers share one decryption: the first one decrypts, the last one re-encrypts.
+    struct alignas(16) SecureBlock
+    {
+        static constexpr uint32_t PhaseEncrypted = 0; //Ciphertext
+        static constexpr uint32_t PhaseDecrypted = 1; //Plaintext in place, shared by the readers
+        static constexpr uint32_t PhaseBusy = 2;      //One thread is encrypting, decrypting or copying
+        static constexpr uint32_t PhaseMask = 3;
+        static constexpr uint32_t ReaderOne = 4;
+
+        static constexpr uint32_t FlagInline = 1;     //Lives inside its SecuredPtr and is never freed
+        static constexpr uint32_t FlagDeferred = 2;   //Stays decrypted after the last reader, see SecureSealer.h
+
+        static constexpr uint32_t LingerScheduled = 1; //The sealer holds a reference and will seal it
+        static constexpr uint32_t LingerExpired = 2;   //Its window is over, the last reader seals it
+        static constexpr uint32_t LingerAccessOne = 256;
+
+        std::atomic<uint32_t> state;
+        std::atomic<uint32_t> refs;
         size_t dataSize;
-        PBYTE protectedData;
-        bool isEncrypted = false;
-        bool overwriteOnExit;
-        weak_ptr<T> holder;
+        uint32_t flags;
+        std::atomic<uint32_t> linger;                //Deferred sealing: Linger bits and the opens since decrypted
+        std::atomic<uint64_t> fingerprint;           //Keyed fingerprint of the sealed data, 0 when unknown
+#ifdef _SecuredMetrics
+        uint64_t exposedAt;                          //When the data was last decrypted or written in clear
+#endif
+
+        PBYTE Data() { return reinterpret_cast<PBYTE>(this + 1); }
+    };
+
+    //Room for the inline block of a SecuredPtr, Size is the header plus the padded data.
+    //An unused inline block has no reference, the owner claims it for values that fit.
+    template <size_t Size> struct alignas(16) SecureInlineStorage
+    {
+        BYTE data[Size];
+
+        SecureInlineStorage()
+        {
+            SecureBlock* b = new (data) SecureBlock();
+            b->state.store(SecureBlock::PhaseEncrypted, std::memory_order_relaxed);
+            b->refs.store(0, std::memory_order_relaxed);
+            b->dataSize = 0;
+            b->flags = SecureBlock::FlagInline;
+            b->linger.store(0, std::memory_order_relaxed);
+            b->fingerprint.store(0, std::memory_order_relaxed);
+#ifdef _SecuredMetrics
+            b->exposedAt = 0;
+#endif
+        }
+        ~SecureInlineStorage()
+        {
+            SecureZeroMemory(data, Size);
+        }
+        SecureBlock* Block() { return reinterpret_cast<SecureBlock*>(data); }
+    };
+
+    template <> struct SecureInlineStorage<0>
+    {
+        SecureBlock* Block() { return nullptr; }
+    };
+
+    //Serialized value a SecuredPtr copies into its own encrypted block the first time it is accessed,
+    //see SecuredPtr::LoadOnFirstUse(). SecureFile hands out its entries this way.
+    class SecureLazySource
+    {
+    public:
+        virtual ~SecureLazySource() {}
+        //Serialized size of the value in bytes
+        virtual size_t GetSize() const = 0;
+        //Writes the GetSize() bytes of the value to dest, false when they cannot be produced (dest is then wiped)
+        virtual bool Read(PBYTE dest) const = 0;
+    };
+
+    class SecureFileWriter;
+
+    //InlineSize is the largest serialized value kept inside the SecuredPtr object instead of a separate
+    //allocation, 0 disables the small buffer. Inline values are copied instead of shared between copies.
+    template <typename T, typename Backend = DefaultCryptBackend, typename Allocator = DefaultSecureAllocator, size_t InlineSize = 0>
+    class SecuredPtr : private SecureRegistryHook, private SecureExpiryHook
+    {
+    private:
+        typedef SecureTraits<T> Traits;
+
+        static constexpr uint32_t PhaseEncrypted = SecureBlock::PhaseEncrypted;
+        static constexpr uint32_t PhaseDecrypted = SecureBlock::PhaseDecrypted;
+        static constexpr uint32_t PhaseBusy = SecureBlock::PhaseBusy;
+        static constexpr uint32_t PhaseMask = SecureBlock::PhaseMask;
+        static constexpr uint32_t ReaderOne = SecureBlock::ReaderOne;
+
+        static constexpr size_t InlineStorageSize = InlineSize > 0 ? sizeof(SecureBlock) + Backend::GetBlockSize(InlineSize) : 0;
+
+        mutable std::atomic<SecureBlock*> block{ nullptr };
+        mutable std::atomic_flag blockLock = ATOMIC_FLAG_INIT; //Guards the exchange of block against pinning it
+        mutable std::shared_ptr<const SecureLazySource> lazy; //Value to load while block is empty, under blockLock
+        std::atomic<bool> overwriteOnExit;
+        std::atomic<bool> deferredSeal{ false };
+        std::atomic<uint64_t> plainVersion{ 0 }; //Changes with the data, tells stale SecurePlainCache entries
+        std::atomic<bool> plainCached{ false };  //The data was put in SecurePlainCache at least once
+        std::atomic<uint64_t> assignment{ 1 };   //Ticket of the latest value, an async_assign() installs only its own
+        std::atomic<uint32_t> pendingAssigns{ 0 }; //async_assign() tasks not destroyed yet, the destructor waits for them
+        weak_ptr<T> holder; //Shared by the '&' handles of types not used in place (strings, vectors)
+        std::atomic_flag holderLock = ATOMIC_FLAG_INIT;
+        SecureInlineStorage<InlineStorageSize> inlineStorage;
 #ifdef _ShowDebugVal
         shared_ptr<T> debugval; //For debugging purpose seeing the real value and must be disabled for versions requiring encryption in memory
 #endif
-        void internalassign(const T* obj)
+
+#ifdef _SecuredMetrics
+        static SecureMetrics::Counters& Metrics()
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
-            if (obj == nullptr)
-            {
+            return SecureMetrics::ForType<T>();
+        }
+#endif
+
+        //Start of a span of exposure, 0 when it is not sampled or without _SecuredMetrics
+        static uint64_t ExposureStart()
+        {
+#ifdef _SecuredMetrics
+            return SecureMetrics::Sample() ? SecureMetrics::Now() : 0;
+#else
+            return 0;
+#endif
+        }
+
+        static void RecordExposure(uint64_t start)
+        {
+#ifdef _SecuredMetrics
+            if (start != 0)
+                Metrics().exposure.Record(SecureMetrics::Now() - start);
+#else
+            (void)start;
+#endif
+        }
+
+        //The data of b is in clear from now on
+        static void MarkExposed(SecureBlock* b)
+        {
+#ifdef _SecuredMetrics
+            b->exposedAt = ExposureStart();
+#else
+            (void)b;
+#endif
+        }
+
+        //Runs the backend call crypt() on count buffers, timed as an encryption or a decryption with _SecuredMetrics
+        template <typename Crypt>
+        static bool CryptCall(bool encrypt, Crypt&& crypt, size_t count = 1)
+        {
+#ifdef _SecuredMetrics
+            SecureMetrics::Counters& m = Metrics();
+            (encrypt ? m.encryptions : m.decryptions).fetch_add(count, std::memory_order_relaxed);
+            if (!SecureMetrics::Sample())
+                return crypt();
+            uint64_t start = SecureMetrics::Now();
+            bool result = crypt();
+            (encrypt ? m.encrypt : m.decrypt).Record((SecureMetrics::Now() - start) / (count > 0 ? count : 1));
+            return result;
+#else
+            (void)encrypt;
+            (void)count;
+            return crypt();
+#endif
+        }
+
+        static PBYTE AllocateSecure(size_t size)
+        {
+            PBYTE mem = Allocator::Allocate(size);
+#ifdef _SecuredMetrics
+            if (mem != nullptr)
+                Metrics().Allocated(size);
+#endif
+            return mem;
+        }
+
+        //The allocator wipes what it takes back
+        static void DeallocateSecure(PBYTE ptr, size_t size)
+        {
+#ifdef _SecuredMetrics
+            if (ptr != nullptr)
+                Metrics().Wiped(size);
+#endif
+            Allocator::Deallocate(ptr, size);
+        }
+
+        static void SpinLock(std::atomic_flag& flag)
+        {
+            if (!flag.test_and_set(std::memory_order_acquire))
                 return;
+#ifdef _SecuredMetrics
+            uint64_t start = SecureMetrics::Now();
+#endif
+            while (flag.test_and_set(std::memory_order_acquire))
+                std::this_thread::yield();
+#ifdef _SecuredMetrics
+            Metrics().lockWait.Record(SecureMetrics::Now() - start);
+#endif
+        }
+
+        //Waits till no thread encrypts, decrypts or copies b and returns its state
+        static uint32_t WaitWhileBusy(SecureBlock* b)
+        {
+#ifdef _SecuredMetrics
+            uint64_t start = SecureMetrics::Now();
+#endif
+            uint32_t s;
+            do
+            {
+                std::this_thread::yield();
+                s = b->state.load(std::memory_order_acquire);
+            } while ((s & PhaseMask) == PhaseBusy);
+#ifdef _SecuredMetrics
+            Metrics().lockWait.Record(SecureMetrics::Now() - start);
+#endif
+            return s;
+        }
+
+        //Keeps the current key of a rotatable backend from being retired by SecureRegistry::Rekey() while a block
+        //sealed under it is not installed yet, held from the creation of a block to its installation
+        class KeyPin
+        {
+        public:
+            KeyPin()
+            {
+#ifdef _SecuredRegistry
+                if constexpr (IsRotatableBackend<Backend>::value)
+                    generation = Backend::PinKey();
+#endif
             }
-            //if protectedData is already pointing to something,
-            //securely overwrite and delete it
-            if (protectedData)
+            ~KeyPin()
             {
-                SecureWipeData();
-                free(protectedData);
+#ifdef _SecuredRegistry
+                if constexpr (IsRotatableBackend<Backend>::value)
+                    Backend::UnpinKey(generation);
+#endif
             }
+#ifdef _SecuredRegistry
+        private:
+            uint32_t generation = 0;
+#endif
+        };
 
-            //Re-format the data
-            size_t mod;
-            size_t dataBlockSize;
+        static size_t GetAllocSize(size_t dataSize)
+        {
+            return sizeof(SecureBlock) + Backend::GetBlockSize(dataSize);
+        }
 
-            //Get size of the object when not called from assign()
-            PBYTE orgdata = nullptr;
-            bool isFreeRequired = false;
-            if (dataSize == 0)
+        //New unsealed block of dataSize bytes with one reference for the caller
+        static SecureBlock* AllocateBlock(size_t dataSize)
+        {
+            PBYTE mem = AllocateSecure(GetAllocSize(dataSize));
+            if (mem == nullptr)
+                return nullptr;
+            SecureBlock* b = new (mem) SecureBlock();
+            b->state.store(PhaseDecrypted, std::memory_order_relaxed);
+            b->refs.store(1, std::memory_order_relaxed);
+            b->dataSize = dataSize;
+            b->flags = 0;
+            b->linger.store(0, std::memory_order_relaxed);
+            b->fingerprint.store(0, std::memory_order_relaxed);
+            MarkExposed(b);
+            return b;
+        }
+
+        //Inline block set up for a value of dataSize bytes with one reference for the caller,
+        //nullptr when the value does not fit or the block is still used by readers of a previous value.
+        //When it is the current block readers wait on PhaseBusy till the caller seals the new value.
+        SecureBlock* ClaimInlineBlock(size_t dataSize)
+        {
+            SecureBlock* ib = inlineStorage.Block();
+            if (ib == nullptr || dataSize == 0 || dataSize > InlineSize)
+                return nullptr;
+            SpinLock(blockLock);
+            //Nobody can pin it while the lock is held, so only the owner reference may be left
+            uint32_t expected = block.load(std::memory_order_relaxed) == ib ? 1 : 0;
+            bool claimed = ib->refs.load(std::memory_order_acquire) == expected;
+            if (claimed)
             {
-                GetSize<T>(*obj, dataSize);
-                if (dataSize == 0)
-                    return; // we do not anything if size cannot be calculated
-                serialize<T>(*obj, &orgdata);
-                if (orgdata != nullptr)	// KW fix - @AE 04/10/2022
-                    isFreeRequired = true;
+                ib->refs.store(expected + 1, std::memory_order_relaxed);
+                ib->state.store(PhaseBusy, std::memory_order_relaxed);
+                ib->dataSize = dataSize;
+                ib->fingerprint.store(0, std::memory_order_relaxed);
+                MarkExposed(ib);
             }
-            else
-                orgdata = (PBYTE)obj; // if size is already provided then we do not do any calcuated size and treat as BYTE byffer
+            blockLock.clear(std::memory_order_release);
+            return claimed ? ib : nullptr;
+        }
 
-            //CryptProtectMemory requires data to be a multiple of its block size
-            if (mod = dataSize % CRYPTPROTECTMEMORY_BLOCK_SIZE)
-                dataBlockSize = dataSize + (CRYPTPROTECTMEMORY_BLOCK_SIZE - mod);
-            else
-                dataBlockSize = dataSize;
+        //Unsealed block for a new value, the inline block when possible.
+        //Inline blocks are always sealed at once, the sealer could outlive their SecuredPtr.
+        SecureBlock* NewBlock(size_t dataSize)
+        {
+            SecureBlock* b = ClaimInlineBlock(dataSize);
+            if (b != nullptr)
+                return b;
+            b = AllocateBlock(dataSize);
+            if (b != nullptr && deferredSeal.load(std::memory_order_relaxed))
+                b->flags |= SecureBlock::FlagDeferred;
+            return b;
+        }
+
+        //Fingerprints the plaintext of b before it is encrypted, only with _SecuredFingerprint
+        static void UpdateFingerprint(SecureBlock* b)
+        {
+#ifdef _SecuredFingerprint
+            b->fingerprint.store(SecureFingerprint::Compute(b->Data(), b->dataSize), std::memory_order_relaxed);
+#else
+            (void)b;
+#endif
+        }
 
-            protectedData = (PBYTE)malloc(dataBlockSize);
-            if (protectedData != nullptr && orgdata != nullptr)	// KW fix - @AE 04/10/2022
-                memcpy(protectedData, orgdata, dataSize);
-            if (isFreeRequired)
+        //Encrypts a block the caller has to itself: a new block or one it moved to PhaseBusy.
+        //parallel spreads the work on the SecureWorkerPool threads.
+        static void SealBlock(SecureBlock* b, bool parallel = false)
+        {
+            UpdateFingerprint(b);
+            FinishSeal(b, CryptCall(true, [b, parallel] { return CryptBlock(b, true, parallel); }));
+        }
+
+        //Protect() or Unprotect() of the data of b, cut in chunks processed side by side on the SecureWorkerPool
+        //threads when parallel and the backend is seekable
+        static bool CryptBlock(SecureBlock* b, bool encrypt, bool parallel)
+        {
+            PBYTE data = b->Data();
+            size_t dataBlockSize = Backend::GetBlockSize(b->dataSize);
+            if constexpr (IsSeekableBackend<Backend>::value)
             {
-                SecureZeroMemory(orgdata, _msize(orgdata));
-                free(orgdata);
+                if (parallel)
+                {
+                    typename Backend::Nonce nonce;
+                    if (encrypt)
+                    {
+                        if (!Backend::NewNonce(nonce))
+                            return false;
+                        Backend::SetNonce(data, dataBlockSize, nonce);
+                    }
+                    else
+                        nonce = Backend::GetNonce(data, dataBlockSize);
+                    return SecureWorkerPool::Instance().ParallelFor(dataBlockSize - Backend::TrailerSize,
+                        [&nonce, data](size_t offset, size_t len) { return Backend::CryptRange(nonce, offset, data + offset, len); });
+                }
             }
+            (void)parallel;
+            return encrypt ? Backend::Protect(data, dataBlockSize) : Backend::Unprotect(data, dataBlockSize);
+        }
+
+        //Publishes the outcome of the encryption of a block SealBlock() or ProtectMany() started
+        static void FinishSeal(SecureBlock* b, bool sealed)
+        {
+#ifdef _SecuredMetrics
+            if (sealed)
+                RecordExposure(b->exposedAt);
+            b->exposedAt = 0;
+#endif
+            //A new window and access count start with the next decryption
+            if (b->flags & SecureBlock::FlagDeferred)
+                b->linger.fetch_and(SecureBlock::LingerScheduled, std::memory_order_relaxed);
+            b->state.store(sealed ? PhaseEncrypted : PhaseDecrypted, std::memory_order_release);
         }
 
-        //Serialize
-        template<typename T>
-        typename std::enable_if<std::is_same<T, CString>::value, void>::type* serialize(const T& str, PBYTE* out)
+        //Whether the last reader of a deferred block may leave it decrypted
+        static bool CanLinger(SecureBlock* b)
         {
-            const std::size_t size = str.GetLength();
-            if (size > 0)
+            if (!(b->flags & SecureBlock::FlagDeferred))
+                return false;
+            uint32_t l = b->linger.load(std::memory_order_relaxed);
+            return !(l & SecureBlock::LingerExpired) && l / SecureBlock::LingerAccessOne < SecureSealer::GetMaxAccesses();
+        }
+
+        static constexpr size_t ProtectBatchSize = 64;
+
+        //Encrypts or decrypts blocks the caller moved to PhaseBusy in one backend call, then releases them
+        static bool CryptBlocks(SecureBlock** blocks, size_t count, bool encrypt)
+        {
+            if (count == 0)
+                return true;
+            PBYTE buffers[ProtectBatchSize];
+            size_t sizes[ProtectBatchSize];
+            bool results[ProtectBatchSize];
+            for (size_t i = 0; i < count; i++)
             {
-                *out = (PBYTE)malloc(size * sizeof(wchar_t));
-                if (*out != nullptr)										// KW fix - @AE 04/10/2022
-                    memcpy(*out, str.GetString(), size * sizeof(wchar_t));
+                if (encrypt)
+                    UpdateFingerprint(blocks[i]);
+                buffers[i] = blocks[i]->Data();
+                sizes[i] = Backend::GetBlockSize(blocks[i]->dataSize);
             }
-            return nullptr;
+            CryptCall(encrypt, [&] { return CryptMany<Backend>(buffers, sizes, count, results, encrypt); }, count);
+            bool all = true;
+            for (size_t i = 0; i < count; i++)
+            {
+                SecureBlock* b = blocks[i];
+                if (encrypt)
+                    FinishSeal(b, results[i]);
+                else
+                {
+                    if (results[i])
+                        MarkExposed(b);
+                    b->state.store(results[i] ? PhaseDecrypted : PhaseEncrypted, std::memory_order_release);
+                }
+                all = all && results[i];
+                ReleaseBlock(b);
+            }
+            return all;
+        }
+
+        //Encrypts b if it is decrypted and nobody reads it
+        static void SealIdleBlock(SecureBlock* b)
+        {
+            uint32_t s = PhaseDecrypted;
+            if (b->state.compare_exchange_strong(s, PhaseBusy, std::memory_order_acquire))
+                SealBlock(b);
         }
 
-        template<typename T>
-        typename std::enable_if<std::is_same<T, std::wstring>::value, void>::type* serialize(const T& str, PBYTE* out)
+        //Hands an idle decrypted block to the sealer, which takes a reference till its window is over.
+        //The reference is taken before LingerScheduled is set so that PinUniqueBlock() never undercounts.
+        static void ScheduleSeal(SecureBlock* b)
         {
-            const std::size_t size = str.length();
-            if (size > 0)
+            uint32_t l = b->linger.load(std::memory_order_relaxed);
+            if (l & SecureBlock::LingerScheduled)
+                return;
+            b->refs.fetch_add(1, std::memory_order_relaxed);
+            while (!(l & SecureBlock::LingerScheduled))
             {
-                *out = (PBYTE)malloc(size * sizeof(wchar_t));
-                memcpy(*out, str.c_str(), size * sizeof(wchar_t));
+                if (b->linger.compare_exchange_weak(l, l | SecureBlock::LingerScheduled, std::memory_order_acq_rel))
+                {
+                    if (SecureSealer::Instance().Schedule(b, &ExpireBlock))
+                        return;
+                    //No sealer thread, nothing may linger
+                    b->linger.fetch_and(~SecureBlock::LingerScheduled, std::memory_order_acq_rel);
+                    SealIdleBlock(b);
+                    break;
+                }
             }
-            return nullptr;
+            b->refs.fetch_sub(1, std::memory_order_relaxed); //The caller still pins b
         }
 
-        template<typename T>
-        typename std::enable_if<std::is_same<T, std::string>::value, void>::type* serialize(const T& str, PBYTE* out)
+        //Called by the sealer when the window of b is over
+        static void ExpireBlock(void* item)
         {
-            const std::size_t size = str.length();
-            if (size > 0)
+            SecureBlock* b = static_cast<SecureBlock*>(item);
+            //Readers still using it seal it when the last one leaves
+            b->linger.fetch_or(SecureBlock::LingerExpired, std::memory_order_acq_rel);
+            SealIdleBlock(b);
+            b->linger.fetch_and(~SecureBlock::LingerScheduled, std::memory_order_acq_rel);
+            //A reader that left in between did not schedule it again
+            SealIdleBlock(b);
+            ReleaseBlock(b);
+        }
+
+        //Drops one reference, the last one wipes and frees the block.
+        //An inline block is only wiped, it can be claimed again once it has no reference.
+        static void ReleaseBlock(SecureBlock* b)
+        {
+            if (b == nullptr)
+                return;
+            if (b->flags & SecureBlock::FlagInline)
+            {
+                //The owner reference is dropped only after the block was replaced,
+                //so the last reference cannot be pinned again by anybody else
+                uint32_t r = b->refs.load(std::memory_order_acquire);
+                for (;;)
+                {
+                    if (r == 1)
+                    {
+                        SecureZeroMemory(b->Data(), Backend::GetBlockSize(b->dataSize));
+#ifdef _SecuredMetrics
+                        Metrics().Wiped(Backend::GetBlockSize(b->dataSize));
+#endif
+                        b->refs.store(0, std::memory_order_release);
+                        return;
+                    }
+                    if (b->refs.compare_exchange_weak(r, r - 1, std::memory_order_acq_rel))
+                        return;
+                }
+            }
+            if (b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
             {
-                *out = (PBYTE)malloc(size * sizeof(char));
-                memcpy(*out, str.c_str(), size * sizeof(char));
+                size_t allocSize = GetAllocSize(b->dataSize);
+                b->~SecureBlock();
+                DeallocateSecure(reinterpret_cast<PBYTE>(b), allocSize);
             }
-            return nullptr;
         }
 
-        template<typename T>
-        typename std::enable_if<(std::is_class<T>::value || std::is_fundamental<T>::value) && !(std::is_same<T, std::wstring>::value || std::is_same<T, std::string>::value || std::is_same<T, CString>::value), void>::type* serialize(const T& str, PBYTE* out)
+        //Re-encrypts b under the current key when it is encrypted. With staleOnly only when a rotatable backend
+        //encrypted it under an older key. Decrypted data is sealed under the current key by its last reader.
+        static bool RekeyBlock(SecureBlock* b, bool staleOnly)
         {
-            const std::size_t size = sizeof(str);
-            if (size > 0)
+            if (staleOnly && !IsRotatableBackend<Backend>::value)
+                return true;
+            uint32_t s = b->state.load(std::memory_order_acquire);
+            for (;;)
+            {
+                uint32_t phase = s & PhaseMask;
+                if (phase == PhaseBusy)
+                    s = WaitWhileBusy(b);
+                else if (phase != PhaseEncrypted)
+                    return true;
+                else if (b->state.compare_exchange_weak(s, PhaseBusy, std::memory_order_acquire))
+                    break;
+            }
+            size_t dataBlockSize = Backend::GetBlockSize(b->dataSize);
+            if constexpr (IsRotatableBackend<Backend>::value)
             {
-                *out = (PBYTE)malloc(size);
-                memcpy(*out, &str, size);
+                if (staleOnly && Backend::IsCurrentKey(b->Data(), dataBlockSize))
+                {
+                    b->state.store(PhaseEncrypted, std::memory_order_release);
+                    return true;
+                }
             }
-            return nullptr;
+            if (!CryptCall(false, [b, dataBlockSize] { return Backend::Unprotect(b->Data(), dataBlockSize); }))
+            {
+                b->state.store(PhaseEncrypted, std::memory_order_release);
+                return false;
+            }
+            MarkExposed(b);
+            SealBlock(b);
+            return (b->state.load(std::memory_order_relaxed) & PhaseMask) == PhaseEncrypted;
         }
 
-        //Deserialize
-        template<typename T>
-        typename std::enable_if<std::is_same<T, std::string>::value, void>::type* Deserialize(T* str)
+        //Called with blockLock held before b becomes the current block: a block sealed before the key was
+        //rotated may be installed after SecureRegistry::Rekey() walked past this SecuredPtr
+        static void RefreshKey(SecureBlock* b)
         {
-            new (str) T(reinterpret_cast<char*>(protectedData), dataSize / sizeof(char));
-            return nullptr;
+#ifdef _SecuredRegistry
+            if (b != nullptr)
+                RekeyBlock(b, true);
+#else
+            (void)b;
+#endif
         }
-        template<typename T>
-        typename std::enable_if<std::is_same<T, std::wstring>::value || std::is_same<T, CString>::value, void>::type* Deserialize(T* str)
+
+        void Register()
         {
-            new (str) T(reinterpret_cast<wchar_t*>(protectedData), dataSize / sizeof(wchar_t));
-            return nullptr;
+#ifdef _SecuredRegistry
+            SecureRegistry::Instance().Add(this, &RegistryVisit);
+#endif
         }
 
-        //GetSize
-        template<typename T>
-        typename std::enable_if<std::is_same<T, CString>::value, void>::type* GetSize(const T& str, size_t& siz)
+        void Unregister()
         {
-            siz = str.GetLength() * sizeof(wchar_t);
-            return nullptr;
+#ifdef _SecuredRegistry
+            SecureRegistry::Instance().Remove(this);
+#endif
         }
-        template<typename T>
-        typename std::enable_if<std::is_same<T, std::string>::value, void>::type* GetSize(const T& str, size_t& siz)
+
+#ifdef _SecuredExpiry
+        //Runs on the SecureExpiry thread once the deadline of node has passed, the destructor waits for it
+        static void ExpireNode(SecureExpiryNode* node)
         {
-            siz = str.length();
-            return nullptr;
+            static_cast<SecuredPtr*>(node)->Expire();
         }
-        template<typename T>
-        typename std::enable_if<std::is_same<T, std::wstring>::value, void>::type* GetSize(const T& str, size_t& siz)
+
+        //Empties this SecuredPtr without cloning or loading anything, it runs under the lock of the timer wheel
+        void Expire()
         {
-            siz = str.length() * sizeof(wchar_t);
-            return nullptr;
+            DropData(overwriteOnExit);
         }
-        template<typename T>
-        typename std::enable_if< std::is_fundamental<T>::value, void>::type* GetSize(const T& str, size_t& siz)
+#endif
+
+        //Empties this SecuredPtr without cloning or loading anything: a value not loaded yet is dropped unread and
+        //a block shared with copies loses one reference. With wipe a block nobody else holds is zeroed first,
+        //the allocator wipes it again when it is released.
+        void DropData(bool wipe)
         {
-            siz = sizeof(str);
-            return nullptr;
+            std::shared_ptr<const SecureLazySource> source;
+            SecureBlock* b = TakeBlock(source);
+            //Nobody else can pin a detached block, so a single reference means no reader either
+            if (b != nullptr && wipe && b->refs.load(std::memory_order_acquire) == 1)
+                SecureZeroMemory(b->Data(), Backend::GetBlockSize(b->dataSize));
+            ReleaseBlock(b);
+#ifdef _ShowDebugVal
+            debugval.reset();
+#endif
         }
 
-        template<typename T>
-        typename std::enable_if<std::is_class<T>::value && !(std::is_same<T, std::wstring>::value || std::is_same<T, std::string>::value || std::is_same<T, CString>::value), void>::type* GetSize(const T& str, size_t& siz)
+        //The deadline of a copy is the one of its source, called out of any lock of this SecuredPtr
+        void CopyExpiry(const SecuredPtr& other)
         {
-            siz = sizeof(str);
-            return nullptr;
+#ifdef _SecuredExpiry
+            SecureExpiry::Clock::time_point deadline = other.GetExpiry();
+            if (deadline != SecureExpiry::Clock::time_point::max())
+                SetExpiryAt(deadline);
+            else
+                CancelExpiry();
+#else
+            (void)other;
+#endif
         }
 
-        //GetSharedPtr
-        template<typename T>
-        typename std::enable_if<std::is_same<T, std::wstring>::value || std::is_same<T, std::string>::value || std::is_same<T, CString>::value, void>::type* GetSharedPtr(shared_ptr<T>& nptr)
+#ifdef _SecuredRegistry
+        //Runs action for SecureRegistry on the SecuredPtr of node, which cannot be destroyed meanwhile
+        static bool RegistryVisit(SecureRegistryNode* node, SecureRegistryAction action)
+        {
+            SecuredPtr* self = static_cast<SecuredPtr*>(node);
+            if (action == SecureRegistryAction::Wipe)
+            {
+                self->ClearData();
+                return true;
+            }
+            //Entries not loaded yet hold no ciphertext under the process key
+            SecureBlock* b = self->PinBlock(false);
+            if (b == nullptr)
+                return true;
+            bool result = RekeyBlock(b, action == SecureRegistryAction::Refresh);
+            ReleaseBlock(b);
+            return result;
+        }
+#endif
+
+        //Current block with one more reference, it stays valid whatever happens to this SecuredPtr
+        //(as long as the SecuredPtr itself lives for an inline block).
+        //A value waiting in lazy is loaded first when load is set, else it is copied to source when given.
+        SecureBlock* PinBlock(bool load = true, std::shared_ptr<const SecureLazySource>* source = nullptr) const
+        {
+            for (;;)
+            {
+                std::shared_ptr<const SecureLazySource> pending;
+                SpinLock(blockLock);
+                SecureBlock* b = block.load(std::memory_order_relaxed);
+                if (b == nullptr && lazy)
+                {
+                    if (load)
+                        pending = lazy;
+                    else if (source != nullptr)
+                        *source = lazy;
+                }
+                if (b != nullptr)
+                    b->refs.fetch_add(1, std::memory_order_relaxed);
+                blockLock.clear(std::memory_order_release);
+                if (!pending)
+                    return b;
+
+                //The value is loaded out of the lock, the other threads keep pinning, assigning and comparing.
+                //It is installed only when nobody replaced or loaded it meanwhile, else the current block is pinned.
+                KeyPin pin;
+                b = LoadLazy(*pending);
+                std::shared_ptr<const SecureLazySource> dropped;
+                SpinLock(blockLock);
+                bool install = block.load(std::memory_order_relaxed) == nullptr && lazy == pending;
+                if (install)
+                {
+                    //A value that cannot be read leaves the SecuredPtr empty
+                    dropped = std::move(lazy);
+                    if (b != nullptr)
+                    {
+                        RefreshKey(b);
+                        b->refs.fetch_add(1, std::memory_order_relaxed);
+                        block.store(b, std::memory_order_release);
+                    }
+                }
+                blockLock.clear(std::memory_order_release);
+                if (install)
+                    return b;
+                ReleaseBlock(b);
+            }
+        }
+
+        //Copies the value of source into a new sealed block with one reference, nullptr when it cannot be read
+        SecureBlock* LoadLazy(const SecureLazySource& source) const
+        {
+            size_t size = source.GetSize();
+            SecureBlock* b = size > 0 ? AllocateBlock(size) : nullptr;
+            if (b == nullptr)
+                return nullptr;
+            if (deferredSeal.load(std::memory_order_relaxed))
+                b->flags |= SecureBlock::FlagDeferred;
+            if (!source.Read(b->Data()))
+            {
+                ReleaseBlock(b);
+                return nullptr;
+            }
+            memset(b->Data() + size, 0, Backend::GetBlockSize(size) - size);
+            SealBlock(b);
+            return b;
+        }
+
+        //Ticket of a new value, taken before the value is installed so that an older async_assign() is dropped
+        uint64_t NextAssignment()
+        {
+            return assignment.fetch_add(1, std::memory_order_acq_rel) + 1;
+        }
+
+        //Installs b, which brings its own reference, and releases the previous block.
+        //With onlyIfSet b is dropped instead when the data was cleared meanwhile.
+        //b is a new value unless ticket is given, it is then dropped when another value was assigned since the ticket.
+        void ReplaceBlock(SecureBlock* b, bool onlyIfSet = false, uint64_t ticket = 0)
+        {
+            if (ticket == 0)
+                NextAssignment();
+            std::shared_ptr<const SecureLazySource> dropped;
+            SpinLock(blockLock);
+            SecureBlock* old = block.load(std::memory_order_relaxed);
+            //Clearing also drops a value not loaded yet
+            bool install = (old != b || lazy) && (!onlyIfSet || old != nullptr) &&
+                (ticket == 0 || assignment.load(std::memory_order_acquire) == ticket);
+            if (install)
+            {
+                RefreshKey(b);
+                block.store(b, std::memory_order_release);
+                dropped = std::move(lazy);
+            }
+            blockLock.clear(std::memory_order_release);
+            InvalidatePlain();
+            //An inline block rewritten in place is already current
+            ReleaseBlock(install ? old : b);
+        }
+
+        //Takes over the reference of b and returns a block this SecuredPtr can own: b itself,
+        //or a copy of its ciphertext when b is the inline block of another SecuredPtr
+        SecureBlock* AdoptBlock(SecureBlock* b)
+        {
+            if (b == nullptr || !(b->flags & SecureBlock::FlagInline))
+                return b;
+            SecureBlock* nb = CloneBlock(b);
+            ReleaseBlock(b);
+            return nb;
+        }
+
+        //Detaches the current block with its reference, or the value waiting to be loaded into source,
+        //this SecuredPtr is left empty
+        SecureBlock* TakeBlock(std::shared_ptr<const SecureLazySource>& source)
         {
-            shared_ptr<T> temp(
-                (T*)malloc(sizeof(T)), // Allocate CString,wstring etc
-                [this](T* x) {
-                    if (this->protectedData != nullptr)
+            NextAssignment();
+            SpinLock(blockLock);
+            SecureBlock* b = block.exchange(nullptr, std::memory_order_acq_rel);
+            source = std::move(lazy);
+            blockLock.clear(std::memory_order_release);
+            InvalidatePlain();
+            return b;
+        }
+
+        //Makes the plaintext cached for this SecuredPtr stale, called when the data was replaced and
+        //before and after it is changed in place
+        void InvalidatePlain()
+        {
+            plainVersion.fetch_add(1);
+            if (plainCached.load())
+                SecurePlainCache::Instance().Invalidate(this);
+        }
+
+        //Reads the data through SecurePlainCache, which skips the crypto when it holds the value.
+        //False when the data is empty or could not be decrypted.
+        bool ReadCached(T& result)
+        {
+            uint64_t version = plainVersion.load();
+            SecurePlainCache& cache = SecurePlainCache::Instance();
+            if (cache.Lookup(this, version, [&result](const BYTE* data, size_t size) { result = Traits::Read(data, size); }))
+                return true;
+            SecureBlock* b = AcquireRead();
+            if (b == nullptr)
+                return false;
+            result = Traits::Read(b->Data(), b->dataSize);
+            //Set before the version is checked again so that a concurrent change always invalidates
+            plainCached.store(true);
+            cache.Insert(this, version, b->Data(), b->dataSize, plainVersion);
+            ReleaseRead(b);
+            return true;
+        }
+
+        //Joins the readers of b, the first reader decrypts it for all of them (in parallel chunks when asked)
+        static bool OpenBlock(SecureBlock* b, bool parallel = false)
+        {
+            uint32_t s = b->state.load(std::memory_order_acquire);
+            for (;;)
+            {
+                uint32_t phase = s & PhaseMask;
+                if (phase == PhaseDecrypted)
+                {
+                    if (b->state.compare_exchange_weak(s, s + ReaderOne, std::memory_order_acquire))
+                    {
+                        if (b->flags & SecureBlock::FlagDeferred)
+                            b->linger.fetch_add(SecureBlock::LingerAccessOne, std::memory_order_relaxed);
+                        return true;
+                    }
+                }
+                else if (phase == PhaseEncrypted)
+                {
+                    if (b->state.compare_exchange_weak(s, PhaseBusy, std::memory_order_acquire))
+                    {
+                        if (!CryptCall(false, [b, parallel] { return CryptBlock(b, false, parallel); }))
+                        {
+                            b->state.store(PhaseEncrypted, std::memory_order_release);
+                            return false;
+                        }
+                        MarkExposed(b);
+                        if (b->flags & SecureBlock::FlagDeferred)
+                            b->linger.fetch_add(SecureBlock::LingerAccessOne, std::memory_order_relaxed);
+                        b->state.store(PhaseDecrypted | ReaderOne, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else
+                    s = WaitWhileBusy(b);
+            }
+        }
+
+        //Leaves the readers of b, the last reader re-encrypts it or, with deferred sealing, leaves it
+        //decrypted for the sealer as long as the policy allows
+        static void CloseBlock(SecureBlock* b, bool parallel = false)
+        {
+            uint32_t s = b->state.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                if ((s >> 2) == 1)
+                {
+                    if (CanLinger(b))
+                    {
+                        if (b->state.compare_exchange_weak(s, PhaseDecrypted, std::memory_order_acq_rel))
+                        {
+                            ScheduleSeal(b);
+                            return;
+                        }
+                    }
+                    else if (b->state.compare_exchange_weak(s, PhaseBusy, std::memory_order_acq_rel))
+                    {
+                        SealBlock(b, parallel);
+                        return;
+                    }
+                }
+                else if (b->state.compare_exchange_weak(s, s - ReaderOne, std::memory_order_release))
+                    return;
+            }
+        }
+
+        //Pinned and decrypted current block, nullptr when there is no data or it could not be decrypted
+        SecureBlock* AcquireRead() const
+        {
+            SecureBlock* b = PinBlock();
+            if (b != nullptr && !OpenBlock(b))
+            {
+                ReleaseBlock(b);
+                return nullptr;
+            }
+            return b;
+        }
+
+        static void ReleaseRead(SecureBlock* b)
+        {
+            CloseBlock(b);
+            ReleaseBlock(b);
+        }
+
+        //Writes the ciphertext of b to dest (Backend::GetBlockSize(b->dataSize) bytes).
+        //The ciphertext is copied as is when b is encrypted, else its plaintext is copied and encrypted.
+        //The fingerprint of the copied data is stored in fingerprint when given.
+        static void CopyOut(SecureBlock* b, PBYTE dest, uint64_t* fingerprint = nullptr)
+        {
+            size_t dataBlockSize = Backend::GetBlockSize(b->dataSize);
+            uint32_t s = b->state.load(std::memory_order_acquire);
+            for (;;)
+            {
+                uint32_t phase = s & PhaseMask;
+                if (phase == PhaseEncrypted)
+                {
+                    if (b->state.compare_exchange_weak(s, PhaseBusy, std::memory_order_acquire))
                     {
-                        std::lock_guard<std::recursive_mutex> lg(m);
-                        //if protectedData is already pointing to something,
-                        //securely overwrite and delete it
-                        if (protectedData)
+                        memcpy(dest, b->Data(), dataBlockSize);
+                        if (fingerprint != nullptr)
+                            *fingerprint = b->fingerprint.load(std::memory_order_relaxed);
+                        b->state.store(PhaseEncrypted, std::memory_order_release);
+                        return;
+                    }
+                }
+                else if (phase == PhaseDecrypted)
+                {
+                    if (b->state.compare_exchange_weak(s, s + ReaderOne, std::memory_order_acquire))
+                    {
+                        memcpy(dest, b->Data(), dataBlockSize);
+                        CloseBlock(b);
+                        if (fingerprint != nullptr)
                         {
-                            SecureWipeData();
-                            free(protectedData);
-                            protectedData = nullptr;
+                            //The plaintext may have been changed in place since it was fingerprinted
+#ifdef _SecuredFingerprint
+                            *fingerprint = SecureFingerprint::Compute(dest, b->dataSize);
+#else
+                            *fingerprint = 0;
+#endif
                         }
-                        dataSize = 0;
-                        internalassign(x);// Though string are immutable but classes like CString can change their internal value so copy back that data
-                        holder.reset();
-                        ProtectMemory(true);
+                        CryptCall(true, [dest, dataBlockSize] { return Backend::Protect(dest, dataBlockSize); });
+                        return;
+                    }
+                }
+                else
+                    s = WaitWhileBusy(b);
+            }
+        }
+
+        //Decrypts len bytes found at offset of the data of b into dest without decrypting b itself.
+        //An encrypted block only has its ciphertext range copied, a decrypted one its plaintext.
+        static bool ReadRange(SecureBlock* b, size_t offset, PBYTE dest, size_t len)
+        {
+            static_assert(IsSeekableBackend<Backend>::value, "ranges need a seekable backend");
+            uint32_t s = b->state.load(std::memory_order_acquire);
+            for (;;)
+            {
+                uint32_t phase = s & PhaseMask;
+                if (phase == PhaseEncrypted)
+                {
+                    if (b->state.compare_exchange_weak(s, PhaseBusy, std::memory_order_acquire))
+                    {
+                        memcpy(dest, b->Data() + offset, len);
+                        typename Backend::Nonce nonce = Backend::GetNonce(b->Data(), Backend::GetBlockSize(b->dataSize));
+                        b->state.store(PhaseEncrypted, std::memory_order_release);
+                        return CryptCall(false, [&] { return Backend::CryptRange(nonce, offset, dest, len); });
+                    }
+                }
+                else if (phase == PhaseDecrypted)
+                {
+                    if (b->state.compare_exchange_weak(s, s + ReaderOne, std::memory_order_acquire))
+                    {
+                        memcpy(dest, b->Data() + offset, len);
+                        CloseBlock(b);
+                        return true;
+                    }
+                }
+                else
+                    s = WaitWhileBusy(b);
+            }
+        }
+
+        //Replaces len bytes found at offset of the data of b with src without decrypting b as a whole.
+        //A keystream is never used for new bytes: an encrypted b is encrypted again under a fresh nonce, see RenonceData().
+        static bool WriteRange(SecureBlock* b, size_t offset, const BYTE* src, size_t len)
+        {
+            static_assert(IsSeekableBackend<Backend>::value, "ranges need a seekable backend");
+            uint32_t s = b->state.load(std::memory_order_acquire);
+            for (;;)
+            {
+                uint32_t phase = s & PhaseMask;
+                if (phase == PhaseEncrypted)
+                {
+                    if (b->state.compare_exchange_weak(s, PhaseBusy, std::memory_order_acquire))
+                    {
+                        size_t dataBlockSize = Backend::GetBlockSize(b->dataSize);
+                        bool result = CryptCall(true, [&] { return RenonceData(b->Data(), dataBlockSize, offset, src, len); });
+                        //Known again the next time the data is decrypted
+                        b->fingerprint.store(0, std::memory_order_relaxed);
+                        b->state.store(PhaseEncrypted, std::memory_order_release);
+                        return result;
+                    }
+                }
+                else if (phase == PhaseDecrypted)
+                {
+                    //Sealed under a fresh nonce by the last reader
+                    if (b->state.compare_exchange_weak(s, s + ReaderOne, std::memory_order_acquire))
+                    {
+                        memcpy(b->Data() + offset, src, len);
+                        b->fingerprint.store(0, std::memory_order_relaxed);
+                        CloseBlock(b);
+                        return true;
                     }
-            delete x; //call the destructor in case of string type objects
+                }
+                else
+                    s = WaitWhileBusy(b);
+            }
+        }
+
+        //Moves the protected buffer data from its nonce to a fresh one, with src put over len bytes at offset.
+        //The buffer is walked in chunks of StreamChunkSize, each one decrypted, patched and encrypted again before
+        //the next, so that no more than one chunk is ever in clear. The buffer is left as it was when the first
+        //chunk cannot be decrypted and is wiped when the walk fails further on.
+        static bool RenonceData(PBYTE data, size_t dataBlockSize, size_t offset, const BYTE* src, size_t len)
+        {
+            typename Backend::Nonce previous = Backend::GetNonce(data, dataBlockSize);
+            typename Backend::Nonce nonce;
+            if (!Backend::NewNonce(nonce))
+                return false;
+            size_t dataLen = dataBlockSize - Backend::TrailerSize;
+            for (size_t pos = 0; pos < dataLen; pos += StreamChunkSize)
+            {
+                size_t n = dataLen - pos < StreamChunkSize ? dataLen - pos : StreamChunkSize;
+                if (!Backend::CryptRange(previous, pos, data + pos, n))
+                {
+                    if (pos > 0)
+                        SecureZeroMemory(data, dataBlockSize);
+                    return false;
+                }
+                if (offset < pos + n && pos < offset + len)
+                {
+                    size_t from = offset > pos ? offset : pos;
+                    size_t to = offset + len < pos + n ? offset + len : pos + n;
+                    memcpy(data + from, src + (from - offset), to - from);
+                }
+                if (!Backend::CryptRange(nonce, pos, data + pos, n))
+                {
+                    SecureZeroMemory(data, dataBlockSize);
+                    return false;
+                }
+            }
+            Backend::SetNonce(data, dataBlockSize, nonce);
+            return true;
+        }
+
+        //Private encrypted copy of b with one reference
+        SecureBlock* CloneBlock(SecureBlock* b)
+        {
+            SecureBlock* nb = NewBlock(b->dataSize);
+            if (nb == nullptr)
+                return nullptr;
+            uint64_t fingerprint = 0;
+            CopyOut(b, nb->Data(), &fingerprint);
+            nb->fingerprint.store(fingerprint, std::memory_order_relaxed);
+            nb->state.store(PhaseEncrypted, std::memory_order_release);
+            return nb;
+        }
+
+        //Pinned current block that no other SecuredPtr shares, cloned first when it is shared.
+        //Used before the data is changed in place.
+        SecureBlock* PinUniqueBlock()
+        {
+            KeyPin pin;
+            for (;;)
+            {
+                SecureBlock* b = PinBlock();
+                if (b == nullptr)
+                    return b;
+                //This SecuredPtr and our pin, plus the sealer when it waits to seal b
+                uint32_t refs = b->refs.load(std::memory_order_acquire);
+                if (b->linger.load(std::memory_order_acquire) & SecureBlock::LingerScheduled)
+                    refs--;
+                if (refs <= 2)
+                    return b;
+                SecureBlock* nb = CloneBlock(b);
+                if (nb == nullptr)
+                    return b;
+                SpinLock(blockLock);
+                bool replaced = block.load(std::memory_order_relaxed) == b;
+                if (replaced)
+                {
+                    RefreshKey(nb);
+                    block.store(nb, std::memory_order_relaxed);
+                }
+                blockLock.clear(std::memory_order_release);
+                ReleaseBlock(b); //Our pin
+                if (replaced)
+                    ReleaseBlock(b); //Our share
+                else
+                    ReleaseBlock(nb);
+            }
+        }
+
+        //Serializes obj into a new encrypted block with one reference, nullptr when there is nothing to protect
+        SecureBlock* CreateBlock(const T* obj, size_t dataSize = 0, bool parallel = false)
+        {
+            if (obj == nullptr)
+            {
+                return nullptr;
+            }
+
+            //Get size of the object when not called from assign()
+            bool isRaw = dataSize != 0; // if size is already provided then we do not do any calcuated size and treat as BYTE byffer
+            if (!isRaw)
+            {
+                dataSize = SizeOf(*obj);
+                if (dataSize == 0)
+                    return nullptr; // we do not anything if size cannot be calculated
+            }
+
+            SecureBlock* b = NewBlock(dataSize);
+            if (b != nullptr)	// KW fix - @AE 04/10/2022
+            {
+                //The plaintext is written straight into the block, no temporary copy is made
+                if (isRaw)
+                    memcpy(b->Data(), obj, dataSize);
+                else
+                    Traits::Write(*obj, b->Data(), dataSize);
+                //The backend requires data to be a multiple of its block size
+                memset(b->Data() + dataSize, 0, Backend::GetBlockSize(dataSize) - dataSize);
+                SealBlock(b, parallel);
+            }
+            return b;
+        }
+
+        //Compares the data with otherSize serialized bytes
+        bool EqualsData(const void* otherData, size_t otherSize)
+        {
+#ifdef _SecuredFingerprint
+            //Compare the fingerprints when this one is known, nothing is decrypted
+            SecureBlock* pb = PinBlock();
+            uint64_t fingerprint = pb != nullptr ? pb->fingerprint.load(std::memory_order_relaxed) : 0;
+            bool sameSize = pb != nullptr && pb->dataSize == otherSize;
+            ReleaseBlock(pb);
+            if (fingerprint != 0)
+            {
+                uint64_t otherFingerprint = sameSize ? SecureFingerprint::Compute(otherData, otherSize) : 0;
+                return sameSize && SecureCompare::Equal(&fingerprint, &otherFingerprint, sizeof(fingerprint));
+            }
+#endif
+            SecureBlock* b = AcquireRead();
+            if (b == nullptr)
+                return otherSize == 0 && this->empty();
+            bool result = b->dataSize == otherSize && SecureCompare::Equal(b->Data(), otherData, otherSize);
+            ReleaseRead(b);
+            return result;
+        }
+
+        //Overwrites the serialized bytes obj holds contiguously (see SecureTraits::Data()), other types are left as they are
+        static void WipeValue(T& obj)
+        {
+            size_t size = SizeOf(obj);
+            const void* data = Traits::Data(obj);
+            if (data != nullptr && size > 0)
+                SecureZeroMemory(const_cast<void*>(data), size);
+        }
+
+        //Serialized size of obj, known at compile time for fixed size types
+        static size_t SizeOf(const T& obj)
+        {
+            if constexpr (Traits::FixedSize)
+                return Traits::Size;
+            else
+                return Traits::GetSize(obj);
+        }
+
+        //Serializes obj over the data of b, which has the size of obj, instead of allocating a new block
+        static void RewriteBlock(SecureBlock* b, const T& obj)
+        {
+            uint32_t s = b->state.load(std::memory_order_acquire);
+            for (;;)
+            {
+                uint32_t phase = s & PhaseMask;
+                if (phase == PhaseEncrypted)
+                {
+                    //The whole data is overwritten so it does not need to be decrypted first
+                    if (b->state.compare_exchange_weak(s, PhaseBusy, std::memory_order_acquire))
+                    {
+                        MarkExposed(b);
+                        Traits::Write(obj, b->Data(), b->dataSize);
+                        memset(b->Data() + b->dataSize, 0, Backend::GetBlockSize(b->dataSize) - b->dataSize);
+                        SealBlock(b);
+                        return;
+                    }
+                }
+                else if (phase == PhaseDecrypted)
+                {
+                    if (b->state.compare_exchange_weak(s, s + ReaderOne, std::memory_order_acquire))
+                    {
+                        Traits::Write(obj, b->Data(), b->dataSize);
+                        b->fingerprint.store(0, std::memory_order_relaxed);
+                        CloseBlock(b);
+                        return;
+                    }
+                }
+                else
+                    s = WaitWhileBusy(b);
+            }
+        }
+
+        //Fingerprint of the serialized obj telling whether a '&' handle changed it, 0 when it cannot be computed
+        static uint64_t DirtyCheck(const T& obj, size_t size)
+        {
+            const void* data = Traits::Data(obj);
+            if (data == nullptr && size > 0)
+                return 0;
+            return SecureFingerprint::Compute(data, size);
+        }
+
+        //Stores the value of the '&' handles once the last one is gone. Nothing is done when it was only read,
+        //a value of the same size is encrypted over the current data and only a new size allocates a block.
+        void WriteBack(const T& obj, size_t originalSize, uint64_t originalFingerprint)
+        {
+            KeyPin pin;
+            size_t size = SizeOf(obj);
+            if (size == originalSize && originalFingerprint != 0)
+            {
+                uint64_t fingerprint = DirtyCheck(obj, size);
+                if (SecureCompare::Equal(&fingerprint, &originalFingerprint, sizeof(fingerprint)))
+                    return;
+            }
+            if (size == originalSize && size > 0)
+            {
+                SecureBlock* b = PinUniqueBlock();
+                if (b != nullptr && b->dataSize == size)
+                {
+                    NextAssignment();
+                    InvalidatePlain();
+                    RewriteBlock(b, obj);
+                    InvalidatePlain();
+                    ReleaseBlock(b);
+                    return;
+                }
+                ReleaseBlock(b);
+            }
+            //Copy back into a new block unless the data was cleared meanwhile
+            ReplaceBlock(CreateBlock(&obj), true);
+        }
+
+        //The next '&' decrypts a new copy instead of sharing the one of the handles already handed out
+        void ForgetHandles() noexcept
+        {
+            SpinLock(holderLock);
+            holder.reset();
+            holderLock.clear(std::memory_order_release);
+        }
+
+        //GetSharedPtr
+        template<typename U>
+        typename std::enable_if<!SecureTraits<U>::InPlace, void>::type* GetSharedPtr(shared_ptr<U>& nptr)
+        {
+            U* x = (U*)malloc(sizeof(U)); // Allocate CString,wstring etc
+            if (x == nullptr)	// KW fix - @AE 04/10/2022
+                return nullptr;
+            SecureBlock* b = AcquireRead();
+            if (b != nullptr)
+            {
+                new (x) U(Traits::Read(b->Data(), b->dataSize));
+                ReleaseRead(b);
+            }
+            else
+                new (x) U();
+
+            //Remember the value handed out so that a handle used only for reading writes nothing back
+            size_t size = SizeOf(*x);
+            uint64_t fingerprint = DirtyCheck(*x, size);
+            uint64_t exposedAt = ExposureStart();
+            shared_ptr<U> temp(
+                x,
+                [this, size, fingerprint, exposedAt](U* x) {
+                    WriteBack(*x, size, fingerprint); // Though string are immutable but classes like CString can change their internal value so copy back that data
+                    WipeValue(*x); //The decrypted copy must not stay in the freed heap
+                    x->~U(); //call the destructor in case of string type objects
+                    free(x);
+                    RecordExposure(exposedAt);
                 });
-            if (temp != nullptr)	// KW fix - @AE 04/10/2022
-                Deserialize<T>(temp.get());
             nptr = temp;   //TODO protected pointer could have been freed but count not as == operator will not work
             return nullptr;
         }
 
-        template<typename T>
-        typename std::enable_if<(std::is_class<T>::value || std::is_fundamental<T>::value) && !(std::is_same<T, std::wstring>::value || std::is_same<T, std::string>::value || std::is_same<T, CString>::value), void>::type* GetSharedPtr(shared_ptr<T>& nptr)
+        template<typename U>
+        typename std::enable_if<SecureTraits<U>::InPlace, void>::type* GetSharedPtr(shared_ptr<U>& nptr)
         {
-            shared_ptr<T> temp(
-                reinterpret_cast<T*>(protectedData),
-                [this](T* x) {
-                    if (this->protectedData != nullptr)
-                    {
-                        std::lock_guard<std::recursive_mutex> lg(m);
-                        holder.reset();
-                        ProtectMemory(true); // Today change in data is not considered
-                    }
+            //The data is changed in place so it must not be shared with copies
+            SecureBlock* b = PinUniqueBlock();
+            if (b == nullptr)
+                return nullptr;
+            if (!OpenBlock(b))
+            {
+                ReleaseBlock(b);
+                return nullptr;
+            }
+            b->fingerprint.store(0, std::memory_order_relaxed);
+            InvalidatePlain();
+            //The handle keeps the block open, the data is re-encrypted when the last reader is gone
+            shared_ptr<U> temp(
+                reinterpret_cast<U*>(b->Data()),
+                [this, b](U*) {
+                    ReleaseRead(b); // Changes made in place are encrypted by the last reader
+                    InvalidatePlain();
                 });
             nptr = temp;
             return nullptr;
@@ -241,70 +1318,178 @@ namespace Secured_Ptr
 
 #ifdef _ShowDebugVal
         //GetSharedPtrDebug
-        template<typename T>
-        typename std::enable_if<std::is_same<T, std::wstring>::value || std::is_same<T, std::string>::value || std::is_same<T, CString>::value, void>::type* GetSharedPtrDebug()
+        template<typename U>
+        void* GetSharedPtrDebug()
         {
-            if (protectedData != nullptr)
+            SecureBlock* b = AcquireRead();
+            if (b != nullptr)
             {
-                shared_ptr<T> temp(
-                    (T*)malloc(sizeof(T)), // Allocate CString,wstring etc
-                    [this](T* x) {
+                shared_ptr<U> temp(
+                    (U*)malloc(sizeof(U)), // Allocate CString,wstring etc
+                    [this](U* x) {
                         if (x != nullptr)
                         {
-                            delete x; // call the destructor in case of string type objects
+                            x->~U(); // call the destructor in case of string type objects
+                            free(x);
                             x = nullptr;
                         }
 
                     });
-                Deserialize<T>(temp.get()); //Initiate the cons
+                new (temp.get()) U(Traits::Read(b->Data(), b->dataSize)); //Initiate the cons
+                ReleaseRead(b);
                 debugval.reset();
                 debugval = temp;   //TODO protected pointer could have been freed but count not as == operator will not work
             }
             return nullptr;
         }
+#endif // _ShowDebugVal
 
-        template<typename T>
-        typename std::enable_if<(std::is_class<T>::value || std::is_fundamental<T>::value) && !(std::is_same<T, std::wstring>::value || std::is_same<T, std::string>::value || std::is_same<T, CString>::value), void>::type* GetSharedPtrDebug()
+        //Gives the serialized data to writer(data, size) in chunks, see WriteTo(). Any type may be streamed out,
+        //SecureFileWriter uses it for the fixed size ones too.
+        template <typename Writer>
+        bool StreamOut(Writer&& writer) const
         {
-            if (protectedData != nullptr)
+            SecureBlock* b = PinBlock();
+            if (b == nullptr)
+                return true;
+            bool ok;
+            if constexpr (IsSeekableBackend<Backend>::value)
             {
-                //Create a copy of the data
-                auto tempdata = (T*)malloc(dataSize);
-                memcpy_s(tempdata, dataSize, protectedData, dataSize);
-                shared_ptr<T> temp(
-                    reinterpret_cast<T*>(tempdata),
-                    [this](T* x) {
-                        if (x != nullptr)
-                        {
-                            free(x);// Only free the memory dont call destructor as it is is not supported 
-                            x = nullptr;
-                        }
-                    });
-                debugval.reset();
-                debugval = temp;
+                PBYTE chunk = AllocateSecure(StreamChunkSize);
+                ok = chunk != nullptr;
+                for (size_t offset = 0; ok && offset < b->dataSize; offset += StreamChunkSize)
+                {
+                    size_t n = b->dataSize - offset < StreamChunkSize ? b->dataSize - offset : StreamChunkSize;
+                    ok = ReadRange(b, offset, chunk, n) && writer((const BYTE*)chunk, n);
+                }
+                if (chunk != nullptr)
+                    DeallocateSecure(chunk, StreamChunkSize);
+            }
+            else
+            {
+                ok = OpenBlock(b);
+                if (ok)
+                {
+                    ok = writer((const BYTE*)b->Data(), b->dataSize);
+                    CloseBlock(b);
+                }
+            }
+            ReleaseBlock(b);
+            return ok;
+        }
+
+        friend class SecureFileWriter;
+
+    public:
+        //Scoped view of the decrypted data returned by access() and caccess().
+        //Decrypts in place on creation and re-encrypts on destruction without any heap allocation.
+        //The view is SecureTraits<T>::View: a string_view for strings, a SecureSpan for vectors and T& otherwise,
+        //SecureTraits<T>::ConstView for the read-only caccess(). Views of the same data on several threads share one decryption.
+        template <bool ReadOnly>
+        class BasicAccess
+        {
+        public:
+            typedef typename std::conditional<ReadOnly, typename SecureConstView<Traits>::Type, typename Traits::View>::type View;
+
+            explicit BasicAccess(typename std::conditional<ReadOnly, const SecuredPtr&, SecuredPtr&>::type ptr) : b(nullptr), owner(nullptr), view()
+            {
+                //A view allowing changes in place needs a block no copy shares, read-only views never copy it
+                if constexpr (!Writable)
+                    b = ptr.AcquireRead();
+                else
+                {
+                    owner = std::addressof(ptr);
+                    ptr.InvalidatePlain();
+                    b = ptr.PinUniqueBlock();
+                    if (b != nullptr && !OpenBlock(b))
+                    {
+                        ReleaseBlock(b);
+                        b = nullptr;
+                    }
+                    //The data may change, it is fingerprinted again when sealed
+                    if (b != nullptr)
+                        b->fingerprint.store(0, std::memory_order_relaxed);
+                }
+                if (b != nullptr)
+                {
+                    if constexpr (Traits::InPlace && ReadOnly)
+                        view = std::addressof(SecureConstView<Traits>::Make(b->Data(), b->dataSize));
+                    else if constexpr (Traits::InPlace)
+                        view = std::addressof(Traits::MakeView(b->Data(), b->dataSize));
+                    else if constexpr (ReadOnly)
+                        view = SecureConstView<Traits>::Make(b->Data(), b->dataSize);
+                    else
+                        view = Traits::MakeView(b->Data(), b->dataSize);
+                }
+            }
+            BasicAccess(BasicAccess&& other) noexcept
+                : b(other.b), owner(other.owner), view(other.view)
+            {
+                other.b = nullptr;
+                other.owner = nullptr;
+            }
+            BasicAccess(const BasicAccess&) = delete;
+            BasicAccess& operator=(const BasicAccess&) = delete;
+
+            ~BasicAccess()
+            {
+                if (b != nullptr)
+                    ReleaseRead(b);
+                //Cached copies taken while the view could change the data are dropped
+                if (owner != nullptr)
+                    owner->InvalidatePlain();
+            }
+
+            //False when the SecuredPtr is empty or could not be decrypted
+            explicit operator bool() const { return b != nullptr; }
+
+            View get() const
+            {
+                if constexpr (Traits::InPlace)
+                    return *view;
+                else
+                    return view;
+            }
+            View operator*() const { return get(); }
+            auto operator->() const
+            {
+                if constexpr (Traits::InPlace)
+                    return view;
+                else
+                    return &view;
             }
-            return nullptr;
-        }
-#endif // _ShowDebugVal
 
-    public:
+        private:
+            //Whether the data can be changed through the view (string views are always read-only)
+            static constexpr bool Writable = !ReadOnly &&
+                (!SecureConstView<Traits>::Declared || !std::is_same<typename Traits::View, typename SecureConstView<Traits>::Type>::value);
+
+            SecureBlock* b;
+            SecuredPtr* owner; //Set for writable views
+            typename std::conditional<Traits::InPlace, typename std::remove_reference<View>::type*, View>::type view;
+        };
+        typedef BasicAccess<false> Access;
+        typedef BasicAccess<true> ConstAccess;
+
 
         //Constructor
         explicit SecuredPtr(bool wipeOnExit = true) noexcept
-            : protectedData(nullptr), overwriteOnExit(wipeOnExit), dataSize(0) {
+            : overwriteOnExit(wipeOnExit) {
             holder.reset()/*, holder2.reset()*/;
+            Register();
         }
         explicit SecuredPtr(T* obj, bool wipeOnExit = true) noexcept
-            : protectedData(nullptr), overwriteOnExit(wipeOnExit), dataSize(0)
+            : overwriteOnExit(wipeOnExit)
         {
+            KeyPin pin;
             if (obj != nullptr)
             {
-                internalassign(const_cast<T*>(obj));
-                ProtectMemory(true);
+                block.store(CreateBlock(obj));
                 delete obj;
             }
             holder.reset();
             // holder2.reset();
+            Register();
         }
         /*explicit SecuredPtr(const T *obj, bool wipeOnExit = true) noexcept
             : protectedData(nullptr), overwriteOnExit(wipeOnExit), reference(nullptr), dataSize(0)
@@ -319,76 +1504,99 @@ namespace Secured_Ptr
             holder.reset();
         }*/
 
-        explicit SecuredPtr(const PBYTE obj, size_t size, bool IsSecured) // Does not clear the PBYTE but operator() clears the PBYTE 
+        explicit SecuredPtr(const PBYTE obj, size_t size, bool IsSecured) // Does not clear the PBYTE but operator() clears the PBYTE
             noexcept
-            : protectedData(nullptr), dataSize(0), overwriteOnExit(true)
+            : overwriteOnExit(true)
         {
+            KeyPin pin;
             if (obj == nullptr)
+            {
+                Register();
                 return;
-            size_t dataBlockSize;
-            dataSize = size;
+            }
             if (IsSecured)
             {
-                size_t mod;
-
-                //CryptProtectMemory requires data to be a multiple of its block size
-                if (mod = size % CRYPTPROTECTMEMORY_BLOCK_SIZE)
-                    dataBlockSize = size + (CRYPTPROTECTMEMORY_BLOCK_SIZE - mod);
-                else
-                    dataBlockSize = size;
-                //protectedptr must be null here as called from constructor
-                protectedData = (PBYTE)malloc(dataBlockSize);
-                if (protectedData != nullptr)		// KW fix - @AE 04/10/2022
+                SecureBlock* b = NewBlock(size);
+                if (b != nullptr)		// KW fix - @AE 04/10/2022
                 {
-                    memcpy(protectedData, obj, dataBlockSize);
-                    isEncrypted = true;
+                    //The backend requires data to be a multiple of its block size
+                    memcpy(b->Data(), obj, Backend::GetBlockSize(size));
+                    b->state.store(PhaseEncrypted, std::memory_order_release);
                 }
-#ifdef _ShowDebugVal
-                ProtectMemory(false);
-                GetSharedPtrDebug<T>();
-                ProtectMemory(true);
-#endif
+                block.store(b);
             }
             else
             {
-                internalassign(reinterpret_cast<const T*>(obj));
-                ProtectMemory(true);
+                block.store(CreateBlock(reinterpret_cast<const T*>(obj), size));
             }
+#ifdef _ShowDebugVal
+            GetSharedPtrDebug<T>();
+#endif
             SetWipeOnExit(true);
             holder.reset();
             // holder2.reset();
+            Register();
         }
 
-        //Copy Constructor
-        SecuredPtr(const SecuredPtr<T>& other) noexcept
-            : protectedData(nullptr), dataSize(0)
+        //Copy Constructor, shares the encrypted block of other
+        SecuredPtr(const SecuredPtr& other) noexcept
+            : overwriteOnExit(true)
         {
             this->swap(other);
+            Register();
+            CopyExpiry(other);
+        }
+
+        //Move Constructor, takes over the encrypted block, wipe and sealing policy of other and leaves it empty.
+        //'&' handles stay bound to other: their changes are written back to other, and dropped while it is empty.
+        SecuredPtr(SecuredPtr&& other) noexcept
+            : overwriteOnExit(other.overwriteOnExit.load()), deferredSeal(other.deferredSeal.load())
+        {
+            KeyPin pin;
+            block.store(AdoptBlock(other.TakeBlock(lazy)), std::memory_order_relaxed);
+            other.ForgetHandles();
+#ifdef _ShowDebugVal
+            debugval = std::move(other.debugval);
+#endif
+            Register();
+            CopyExpiry(other);
+            other.CancelExpiry();
         }
 
         //Copy Constructor
         SecuredPtr(const T& other) noexcept
-            : protectedData(nullptr), dataSize(0)
+            : overwriteOnExit(true)
         {
-            internalassign(const_cast<T*>(&other));
-            ProtectMemory(true);
+            KeyPin pin;
+            block.store(CreateBlock(&other));
+#ifdef _ShowDebugVal
+            GetSharedPtrDebug<T>();
+#endif
             SetWipeOnExit(true);
             holder.reset();
             // holder2.reset();
+            Register();
         }
-        void ClearData()
+        //Replaces the data with the value of source, which is only read and encrypted into a block of this
+        //SecuredPtr the first time the data is used. Till then copies share source and SecureRegistry skips it.
+        //A value that cannot be read then leaves the SecuredPtr empty.
+        void LoadOnFirstUse(std::shared_ptr<const SecureLazySource> source)
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
-            if (protectedData != nullptr)
-            {
-                SecureWipeData();
-                free(protectedData);
-                protectedData = nullptr;
-            }
+            NextAssignment();
+            SpinLock(blockLock);
+            SecureBlock* old = block.exchange(nullptr, std::memory_order_acq_rel);
+            lazy.swap(source);
+            blockLock.clear(std::memory_order_release);
+            InvalidatePlain();
+            ReleaseBlock(old);
+#ifdef _ShowDebugVal
+            debugval.reset();
+#endif
+        }
 
-            this->dataSize = 0;
-            holder.reset();
-            this->isEncrypted = false;
+        void ClearData()
+        {
+            ReplaceBlock(nullptr);
 #ifdef _ShowDebugVal
             debugval.reset();
             /*            if (debugval != nullptr)
@@ -400,19 +1608,91 @@ namespace Secured_Ptr
         //Destructor
         ~SecuredPtr()
         {
+            //The async_assign() tasks still queued or running use this object, their value is dropped
+            NextAssignment();
+            while (pendingAssigns.load(std::memory_order_acquire) != 0)
+                std::this_thread::yield();
+            CancelExpiry();
+            Unregister();
             ClearData();
         }
         void SetWipeOnExit(bool wipe) { overwriteOnExit = wipe; }
-        bool IsProtected() const { return isEncrypted; }
+
+        //Opt-in expiry (_SecuredExpiry): ttl from now the SecureExpiry thread wipes the data and empties this
+        //SecuredPtr, at most one tick (10 ms) late. The deadline belongs to the object and stays when a new value
+        //is assigned, copies take the one of their source. A ttl that is not positive empties it at once.
+        //False when the deadline cannot be set, always without _SecuredExpiry.
+        bool SetExpiry(std::chrono::steady_clock::duration ttl)
+        {
+            return SetExpiryAt(std::chrono::steady_clock::now() + ttl);
+        }
+        bool SetExpiryAt(std::chrono::steady_clock::time_point deadline)
+        {
+#ifdef _SecuredExpiry
+            if (deadline <= std::chrono::steady_clock::now())
+            {
+                CancelExpiry();
+                Expire();
+                return true;
+            }
+            return SecureExpiry::Instance().Schedule(this, deadline, &ExpireNode);
+#else
+            (void)deadline;
+            return false;
+#endif
+        }
+        void CancelExpiry()
+        {
+#ifdef _SecuredExpiry
+            SecureExpiry::Instance().Cancel(this);
+#endif
+        }
+        //Deadline rounded up to the tick, time_point::max() when none is set
+        std::chrono::steady_clock::time_point GetExpiry() const
+        {
+#ifdef _SecuredExpiry
+            return SecureExpiry::Instance().GetDeadline(this);
+#else
+            return std::chrono::steady_clock::time_point::max();
+#endif
+        }
+
+        //Opt-in deferred sealing: the data stays decrypted between accesses within the bounds of the
+        //SecureSealer policy (time window and number of accesses) and the sealer thread encrypts it afterwards.
+        //Applies to the current value at once. Values kept in the inline buffer are always sealed at once.
+        void SetDeferredSeal(bool deferred)
+        {
+            if (deferredSeal.exchange(deferred) == deferred)
+                return;
+            //Blocks carry the flag, the current one is replaced by a copy with the new setting
+            KeyPin pin;
+            uint64_t ticket = assignment.load(std::memory_order_acquire);
+            SecureBlock* b = PinBlock();
+            if (b == nullptr)
+                return;
+            SecureBlock* nb = (b->flags & SecureBlock::FlagInline) ? nullptr : CloneBlock(b);
+            //The copy is not a new value, it is dropped when the data changed meanwhile
+            if (nb != nullptr)
+                ReplaceBlock(nb, true, ticket);
+            ReleaseBlock(b);
+        }
+        bool IsProtected() const
+        {
+            SecureBlock* b = PinBlock();
+            bool result = b != nullptr && (b->state.load(std::memory_order_acquire) & PhaseMask) == PhaseEncrypted;
+            ReleaseBlock(b);
+            return result;
+        }
 
         bool CanDecrypt()
         {
-            if (isEncrypted)
+            if (IsProtected())
             {
                 //Test Decyption
-                if (ProtectMemory(false))
+                SecureBlock* b = AcquireRead();
+                if (b != nullptr)
                 {
-                    ProtectMemory(true);
+                    ReleaseRead(b);
                     return true;
                 }
             }
@@ -422,20 +1702,24 @@ namespace Secured_Ptr
         PBYTE GetProtectedBuffer()
         {
             PBYTE data = nullptr;
-            if (isEncrypted)
+            SecureBlock* b = PinBlock();
+            if (b != nullptr)
             {
                 //Give the whole buffer
-                auto len = _msize(protectedData);
-                data = (PBYTE)malloc(len);
+                data = (PBYTE)malloc(Backend::GetBlockSize(b->dataSize));
                 if (data != nullptr)	// KW fix - @AE 04/10/2022
-                    memcpy(data, protectedData, len);
+                    CopyOut(b, data);
+                ReleaseBlock(b);
             }
             return data;
         }
 
         size_t GetSize()
         {
-            return dataSize;
+            SecureBlock* b = PinBlock();
+            size_t size = b != nullptr ? b->dataSize : 0;
+            ReleaseBlock(b);
+            return size;
         }
 
         //shared_ptr<BYTE[]> GetUnProtectedBuffer()
@@ -458,112 +1742,510 @@ namespace Secured_Ptr
         //    return holder2.lock();
         //}
 
+        //Moves the data to the requested phase when nobody reads it.
+        //While readers are active the data stays decrypted and the last reader re-encrypts it.
         bool ProtectMemory(bool encrypt)
         {
-            if (protectedData == nullptr)
+            SecureBlock* b = PinBlock();
+            if (b == nullptr)
                 return false;
-            std::lock_guard<std::recursive_mutex> lg(m);
-            size_t mod;
+            uint32_t s = b->state.load(std::memory_order_acquire);
+            for (;;)
+            {
+                uint32_t phase = s & PhaseMask;
+                if (phase == PhaseBusy)
+                {
+                    s = WaitWhileBusy(b);
+                    continue;
+                }
+                if ((s >> 2) > 0 || phase == (encrypt ? PhaseEncrypted : PhaseDecrypted))
+                {
+                    ReleaseBlock(b);
+                    return true;
+                }
+                if (b->state.compare_exchange_weak(s, PhaseBusy, std::memory_order_acquire))
+                    break;
+            }
+
             size_t dataBlockSize;
 
-            //CryptProtectMemory requires data to be a multiple of its block size
-            if (mod = dataSize % CRYPTPROTECTMEMORY_BLOCK_SIZE)
-                dataBlockSize = dataSize + (CRYPTPROTECTMEMORY_BLOCK_SIZE - mod);
+            //The backend requires data to be a multiple of its block size
+            dataBlockSize = Backend::GetBlockSize(b->dataSize);
+            bool result;
+            if (encrypt)
+            {
+                SealBlock(b);
+                result = (b->state.load(std::memory_order_relaxed) & PhaseMask) == PhaseEncrypted;
+            }
             else
-                dataBlockSize = dataSize;
-#ifdef _ShowDebugVal
-            if (!isEncrypted)
             {
-                GetSharedPtrDebug<T>();
+                result = CryptCall(false, [b, dataBlockSize] { return Backend::Unprotect(b->Data(), dataBlockSize); });
+                if (result)
+                    MarkExposed(b);
+                b->state.store(result ? PhaseDecrypted : PhaseEncrypted, std::memory_order_release);
             }
-#endif //_ShowDebugVal 
+            SecureZeroMemory(&dataBlockSize, sizeof(dataBlockSize));
+            ReleaseBlock(b);
+            return result;
+        }
 
-            if (encrypt && !isEncrypted)
+        //ProtectMemory() of count objects, whose buffers go through the backend together so that a multi-buffer
+        //backend (LinuxCryptBackend) encrypts them side by side. Like ProtectMemory(), objects with readers are
+        //left to their last reader. Returns true when ProtectMemory() would have for each of them.
+        static bool ProtectMany(SecuredPtr* const* items, size_t count, bool encrypt)
+        {
+            SecureBlock* blocks[ProtectBatchSize];
+            size_t pending = 0;
+            bool all = true;
+            for (size_t i = 0; i < count; i++)
             {
-                isEncrypted = true;
-                if (!CryptProtectMemory(protectedData, dataBlockSize,
-                    CRYPTPROTECTMEMORY_SAME_PROCESS))
+                SecureBlock* b = items[i] != nullptr ? items[i]->PinBlock() : nullptr;
+                if (b == nullptr)
                 {
-                    return false;
+                    all = false;
+                    continue;
                 }
-            }
-            else if (!encrypt && isEncrypted)
-            {
-                isEncrypted = false;
-                if (!CryptUnprotectMemory(protectedData, dataBlockSize,
-                    CRYPTPROTECTMEMORY_SAME_PROCESS))
+                bool claimed = false;
+                uint32_t s = b->state.load(std::memory_order_acquire);
+                for (;;)
                 {
-                    return false;
+                    uint32_t phase = s & PhaseMask;
+                    if (phase == PhaseBusy)
+                    {
+                        //Copies share blocks, b may be one of ours: they are finished before waiting
+                        all = CryptBlocks(blocks, pending, encrypt) && all;
+                        pending = 0;
+                        s = WaitWhileBusy(b);
+                        continue;
+                    }
+                    if ((s >> 2) > 0 || phase == (encrypt ? PhaseEncrypted : PhaseDecrypted))
+                        break;
+                    if (b->state.compare_exchange_weak(s, PhaseBusy, std::memory_order_acquire))
+                    {
+                        claimed = true;
+                        break;
+                    }
+                }
+                if (!claimed)
+                {
+                    ReleaseBlock(b);
+                    continue;
+                }
+                blocks[pending++] = b;
+                if (pending == ProtectBatchSize)
+                {
+                    all = CryptBlocks(blocks, pending, encrypt) && all;
+                    pending = 0;
                 }
             }
-            SecureZeroMemory(&mod, sizeof(mod));
-            SecureZeroMemory(&dataBlockSize, sizeof(dataBlockSize));
-            return true;
+            return CryptBlocks(blocks, pending, encrypt) && all;
         }
+
+        //Wipes and empties this SecuredPtr when it wipes on exit, see SetWipeOnExit(). Its block is zeroed when no
+        //copy or reader holds it, the copies sharing it keep the data. Released blocks are always wiped by the allocator.
         void SecureWipeData()
         {
-            if (overwriteOnExit && protectedData != nullptr && dataSize > 0)
-                SecureZeroMemory(protectedData, dataSize);
+            if (overwriteOnExit)
+                DropData(true);
         }
 
+        //Makes this a copy of other, the encrypted block is shared till one of them changes it
         void swap(const SecuredPtr& other) noexcept
         {
-            if (other.dataSize != 0)
-            {
-                size_t mod;
-                size_t dataBlockSize;
-                //CryptProtectMemory requires data to be a multiple of its block size
-                if (mod = other.dataSize % CRYPTPROTECTMEMORY_BLOCK_SIZE)
-                    dataBlockSize = other.dataSize + (CRYPTPROTECTMEMORY_BLOCK_SIZE - mod);
-                else
-                    dataBlockSize = other.dataSize;
-                if (this->protectedData != nullptr)
-                    free(protectedData);
-                this->protectedData = (PBYTE)malloc(dataBlockSize);
-                if (this->protectedData != nullptr)	// KW fix - @AE 04/10/2022
-                    memcpy_s(this->protectedData, dataBlockSize, other.protectedData, dataBlockSize);
-            }
-
-            this->dataSize = other.dataSize;
-            this->isEncrypted = other.isEncrypted;
-            this->overwriteOnExit = other.overwriteOnExit;
-            this->holder = other.holder;
+            KeyPin pin;
+            //A value other has not loaded yet is shared as it is and each copy loads its own block
+            std::shared_ptr<const SecureLazySource> source;
+            SecureBlock* b = other.PinBlock(false, &source);
+            this->overwriteOnExit = other.overwriteOnExit.load();
+            if (source)
+                LoadOnFirstUse(std::move(source));
+            else
+                ReplaceBlock(AdoptBlock(b));
 #ifdef _ShowDebugVal
-            ProtectMemory(false);
             GetSharedPtrDebug<T>();
-            ProtectMemory(true);
 #endif // _ShowDebugVal
         }
 
         T operator*()
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
-            return *(this->operator&());
+            if (SecurePlainCache::Enabled())
+            {
+                T result{};
+                if (!ReadCached(result))
+                    return T();
+                return result;
+            }
+            SecureBlock* b = AcquireRead();
+            if (b == nullptr)
+                return T();
+            T result(Traits::Read(b->Data(), b->dataSize));
+            ReleaseRead(b);
+            return result;
+        }
+
+        //operator* that leaves the decryption of large data to the SecureWorkerPool, in chunks decrypted side by
+        //side: the calling thread does no crypto. Data below SecureWorkerPool::GetMinAsyncSize() is read at once
+        //and the future is ready. This SecuredPtr may be changed or destroyed before the future is ready.
+        std::future<T> async_access()
+        {
+            SecureBlock* b = PinBlock();
+            if (b == nullptr || (b->flags & SecureBlock::FlagInline) || b->dataSize < SecureWorkerPool::GetMinAsyncSize())
+            {
+                ReleaseBlock(b);
+                std::promise<T> ready;
+                ready.set_value(**this);
+                return ready.get_future();
+            }
+            //The pinned block is all the task uses
+            auto task = std::make_shared<std::packaged_task<T()>>([b] {
+                T result{};
+                bool ok = OpenBlock(b, true);
+                try
+                {
+                    if (ok)
+                        result = Traits::Read(b->Data(), b->dataSize);
+                }
+                catch (...)
+                {
+                    CloseBlock(b, true);
+                    ReleaseBlock(b);
+                    throw;
+                }
+                if (ok)
+                    CloseBlock(b, true);
+                ReleaseBlock(b);
+                return result;
+                });
+            //A task the pool does not take is dropped, its future holds a broken_promise error
+            std::future<T> result = task->get_future();
+            SecureWorkerPool::Instance().Submit([task] { (*task)(); });
+            return result;
+        }
+
+        //operator=(value) that leaves the encryption of a large value to the SecureWorkerPool, in chunks
+        //encrypted side by side. Values below SecureWorkerPool::GetMinAsyncSize() are assigned at once and the
+        //future is ready. Assignments keep their order: the value is dropped instead of installed when another
+        //one was assigned (or written) since the call. Its plaintext is wiped once encrypted or dropped.
+        //The future holds a std::future_error (broken_promise) when the pool cannot take the task, nothing
+        //is encrypted on the calling thread. The future may be dropped: the destructor of this SecuredPtr waits for
+        //the task, so it must not run on the only thread of the SecureWorkerPool while the task is queued.
+        std::future<void> async_assign(T value)
+        {
+            size_t size = SizeOf(value);
+            //The inline block is rewritten in place, it could not be dropped
+            if (size < SecureWorkerPool::GetMinAsyncSize() || size <= InlineSize)
+            {
+                *this = value;
+                WipeValue(value);
+                std::promise<void> ready;
+                ready.set_value();
+                return ready.get_future();
+            }
+            uint64_t ticket = NextAssignment();
+            SetWipeOnExit(true);
+            //Wiped whether the task runs or not, the task is no longer pending once its value is gone
+            pendingAssigns.fetch_add(1, std::memory_order_relaxed);
+            std::shared_ptr<T> plain(new T(std::move(value)), [this](T* x) {
+                WipeValue(*x);
+                delete x;
+                pendingAssigns.fetch_sub(1, std::memory_order_release);
+                });
+            WipeValue(value);
+            auto task = std::make_shared<std::packaged_task<void()>>([this, ticket, plain] {
+                KeyPin pin;
+                SecureBlock* b = CreateBlock(plain.get(), 0, true);
+                WipeValue(*plain);
+                ReplaceBlock(b, false, ticket);
+                });
+            std::future<void> result = task->get_future();
+            SecureWorkerPool::Instance().Submit([task] { (*task)(); });
+            return result;
         }
 
         shared_ptr<T> operator&()
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
             shared_ptr<T> nptr{};
-            if (holder.expired())
+            if constexpr (!Traits::InPlace)
             {
-                ProtectMemory(false);
-                GetSharedPtr<T>(nptr);
-                holder = nptr;
+                //One copy of the value is shared by all the handles and written back by the last one
+                SpinLock(holderLock);
+                nptr = holder.lock();
+                if (nptr == nullptr)
+                {
+                    GetSharedPtr<T>(nptr);
+                    holder = nptr;
+                }
+                holderLock.clear(std::memory_order_release);
             }
-            return holder.lock();
+            else
+                GetSharedPtr<T>(nptr);
+            return nptr;
         }
 
         shared_ptr<T> operator->()
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
             return this->operator&();
         }
 
+        //Decrypted view valid till the end of the scope, cheaper than '->' as nothing is allocated or copied
+        Access access()
+        {
+            return Access(*this);
+        }
+
+        //Read-only decrypted view, the data shared with copies is never copied and nothing is written back
+        ConstAccess caccess() const
+        {
+            return ConstAccess(*this);
+        }
+        ConstAccess access() const
+        {
+            return caccess();
+        }
+
+        //Copies len bytes found at offset of the serialized data to dest, false when the range is outside of it.
+        //With a seekable backend only the range is decrypted, into dest, so the cost depends on len and not on
+        //the size of the data. Otherwise the whole data is decrypted for the copy.
+        bool Read(size_t offset, size_t len, PBYTE dest)
+        {
+            SecureBlock* b = PinBlock();
+            bool ok = b != nullptr && dest != nullptr && offset <= b->dataSize && len <= b->dataSize - offset;
+            if (ok)
+            {
+                if constexpr (IsSeekableBackend<Backend>::value)
+                    ok = ReadRange(b, offset, dest, len);
+                else if ((ok = OpenBlock(b)))
+                {
+                    memcpy(dest, b->Data() + offset, len);
+                    CloseBlock(b);
+                }
+            }
+            ReleaseBlock(b);
+            return ok;
+        }
+
+        //Overwrites len bytes at offset of the serialized data with src, the size of the data does not change.
+        //With a seekable backend the data is never decrypted as a whole: it is encrypted again under a fresh
+        //nonce one chunk at a time, so the cost follows the size of the data but at most StreamChunkSize bytes
+        //are in clear. Otherwise the whole data is decrypted for the change.
+        //Copies sharing the data are not affected, the data is copied (still encrypted) first.
+        bool Write(size_t offset, const BYTE* src, size_t len)
+        {
+            SecureBlock* b = PinUniqueBlock();
+            bool ok = b != nullptr && src != nullptr && offset <= b->dataSize && len <= b->dataSize - offset;
+            if (ok)
+            {
+                NextAssignment();
+                InvalidatePlain();
+                if constexpr (IsSeekableBackend<Backend>::value)
+                    ok = WriteRange(b, offset, src, len);
+                else if ((ok = OpenBlock(b)))
+                {
+                    memcpy(b->Data() + offset, src, len);
+                    b->fingerprint.store(0, std::memory_order_relaxed);
+                    CloseBlock(b);
+                }
+                InvalidatePlain();
+            }
+            ReleaseBlock(b);
+#ifdef _ShowDebugVal
+            GetSharedPtrDebug<T>();
+#endif
+            return ok;
+        }
+
+        //Value of one data member of a struct kept as its raw bytes: int flag = config.get<&Config::flag>();
+        //Only the bytes of the member are decrypted (see Read()), the rest of the struct stays encrypted.
+        //A default value is returned when the data is empty or could not be decrypted.
+        template <auto Member>
+        typename SecureMember<Member>::Type get()
+        {
+            typedef SecureMember<Member> Field;
+            static_assert(std::is_same<typename Field::Class, T>::value, "Member must be a data member of T");
+            static_assert(Traits::InPlace && Traits::FixedSize, "T must be kept as its raw bytes");
+            static_assert(std::is_trivially_copyable<typename Field::Type>::value, "only trivially copyable members can be projected");
+            typename Field::Type value{};
+            if (!Read(Field::Offset(), sizeof(value), reinterpret_cast<PBYTE>(std::addressof(value))))
+                value = typename Field::Type{};
+            return value;
+        }
+
+        //Changes one data member of a struct kept as its raw bytes: config.set<&Config::flag>(1);
+        //The struct is encrypted again under a fresh nonce without being decrypted as a whole (see Write()),
+        //false when the data is empty.
+        template <auto Member>
+        bool set(const typename SecureMember<Member>::Type& value)
+        {
+            typedef SecureMember<Member> Field;
+            static_assert(std::is_same<typename Field::Class, T>::value, "Member must be a data member of T");
+            static_assert(Traits::InPlace && Traits::FixedSize, "T must be kept as its raw bytes");
+            static_assert(std::is_trivially_copyable<typename Field::Type>::value, "only trivially copyable members can be projected");
+            return Write(Field::Offset(), reinterpret_cast<const BYTE*>(std::addressof(value)), sizeof(value));
+        }
+
+        //Bytes moved at once by ReadFrom() and WriteTo()
+        static constexpr size_t StreamChunkSize = 4096;
+
+        //Replaces the data with what reader produces till its end. reader(buffer, size) fills up to size bytes
+        //and returns how many it wrote, 0 at the end and a negative value on error (the data is then unchanged).
+        //Every chunk is read into one buffer from Allocator and encrypted before the next one is read, so at most
+        //StreamChunkSize bytes are ever in clear. sizeHint, the expected total, avoids growing the ciphertext.
+        //A backend that is not seekable (DPAPI) encrypts the whole data once it has been read.
+        template <typename Reader>
+        typename std::enable_if<std::is_invocable_r<ptrdiff_t, Reader&, PBYTE, size_t>::value, bool>::type
+            ReadFrom(Reader&& reader, size_t sizeHint = 0)
+        {
+            static_assert(!Traits::FixedSize, "only variable size types (strings, vectors) can be streamed");
+            KeyPin pin;
+            PBYTE chunk = AllocateSecure(StreamChunkSize);
+            size_t capacity = sizeHint > 0 ? sizeHint : StreamChunkSize;
+            PBYTE buffer = AllocateSecure(capacity);
+            typename std::conditional<IsSeekableBackend<Backend>::value, StreamNonce<Backend>, StreamNonce<void>>::type nonce{};
+            bool ok = chunk != nullptr && buffer != nullptr && nonce.Init();
+            size_t size = 0;
+            while (ok)
+            {
+                ptrdiff_t n = reader(chunk, StreamChunkSize);
+                if (n <= 0 || (size_t)n > StreamChunkSize)
+                {
+                    ok = n == 0;
+                    break;
+                }
+                if (size + n > capacity)
+                {
+                    size_t grown = capacity * 2 >= size + n ? capacity * 2 : size + n;
+                    PBYTE larger = AllocateSecure(grown);
+                    ok = larger != nullptr;
+                    if (ok)
+                        memcpy(larger, buffer, size);
+                    DeallocateSecure(buffer, capacity);
+                    buffer = larger;
+                    capacity = grown;
+                    if (!ok)
+                        break;
+                }
+                //Only ciphertext is kept with a seekable backend
+                ok = CryptCall(true, [&] { return nonce.Crypt(size, chunk, n); });
+                memcpy(buffer + size, chunk, n);
+                size += n;
+            }
+            if (chunk != nullptr)
+                DeallocateSecure(chunk, StreamChunkSize);
+
+            SecureBlock* b = nullptr;
+            if (ok && size > 0)
+            {
+                b = NewBlock(size);
+                ok = b != nullptr;
+            }
+            if (b != nullptr)
+            {
+                size_t dataBlockSize = Backend::GetBlockSize(size);
+                memcpy(b->Data(), buffer, size);
+                //The backend requires data to be a multiple of its block size
+                if constexpr (IsSeekableBackend<Backend>::value)
+                {
+                    size_t padding = dataBlockSize - Backend::TrailerSize - size;
+                    memset(b->Data() + size, 0, padding);
+                    CryptCall(true, [&] { return nonce.Crypt(size, b->Data() + size, padding); });
+                    Backend::SetNonce(b->Data(), dataBlockSize, nonce.value);
+                    //The fingerprint stays unknown, it is computed the first time the data is decrypted
+                    b->state.store(PhaseEncrypted, std::memory_order_release);
+                }
+                else
+                {
+                    memset(b->Data() + size, 0, dataBlockSize - size);
+                    SealBlock(b);
+                }
+            }
+            if (buffer != nullptr)
+                DeallocateSecure(buffer, capacity);
+            if (ok)
+                ReplaceBlock(b);
+            else
+                ReleaseBlock(b);
+            return ok;
+        }
+
+        //Replaces the data with the rest of the file or pipe fd
+        bool ReadFrom(int fd)
+        {
+            size_t sizeHint = 0;
+#ifdef _WIN32
+            return ReadFrom([fd](PBYTE buffer, size_t size) -> ptrdiff_t {
+                return _read(fd, buffer, (unsigned int)size);
+                }, sizeHint);
+#else
+            struct stat st;
+            off_t position = lseek(fd, 0, SEEK_CUR);
+            if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && position >= 0 && st.st_size > position)
+                sizeHint = (size_t)(st.st_size - position);
+            return ReadFrom([fd](PBYTE buffer, size_t size) -> ptrdiff_t {
+                ssize_t n;
+                do
+                    n = ::read(fd, buffer, size);
+                while (n < 0 && errno == EINTR);
+                return n;
+                }, sizeHint);
+#endif
+        }
+
+        //Replaces the data with the rest of stream
+        bool ReadFrom(std::istream& stream)
+        {
+            return ReadFrom([&stream](PBYTE buffer, size_t size) -> ptrdiff_t {
+                stream.read(reinterpret_cast<char*>(buffer), (std::streamsize)size);
+                if (stream.bad())
+                    return -1;
+                return (ptrdiff_t)stream.gcount();
+                });
+        }
+
+        //Gives the data to writer(data, size) in chunks of at most StreamChunkSize bytes, false when writer does.
+        //With a seekable backend each chunk is decrypted on its own into one buffer from Allocator and
+        //the data itself stays encrypted. Otherwise the data is decrypted and given at once.
+        template <typename Writer>
+        typename std::enable_if<std::is_invocable_r<bool, Writer&, const BYTE*, size_t>::value, bool>::type
+            WriteTo(Writer&& writer)
+        {
+            static_assert(!Traits::FixedSize, "only variable size types (strings, vectors) can be streamed");
+            return StreamOut(writer);
+        }
+
+        //Writes the data to the file, pipe or socket fd
+        bool WriteTo(int fd)
+        {
+            return WriteTo([fd](const BYTE* data, size_t size) -> bool {
+                while (size > 0)
+                {
+#ifdef _WIN32
+                    int n = _write(fd, data, (unsigned int)size);
+#else
+                    ssize_t n = ::write(fd, data, size);
+                    if (n < 0 && errno == EINTR)
+                        continue;
+#endif
+                    if (n <= 0)
+                        return false;
+                    data += n;
+                    size -= (size_t)n;
+                }
+                return true;
+                });
+        }
+
+        //Writes the data to stream
+        bool WriteTo(std::ostream& stream)
+        {
+            return WriteTo([&stream](const BYTE* data, size_t size) -> bool {
+                stream.write(reinterpret_cast<const char*>(data), (std::streamsize)size);
+                return !stream.fail();
+                });
+        }
+
         void operator()(PBYTE obj, size_t size, bool IsSecured)
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
-            SecuredPtr<T> temp(obj, size, IsSecured);
+            SecuredPtr temp(obj, size, IsSecured);
             *this = temp;
             SecureZeroMemory(obj, size);
             delete obj;
@@ -571,123 +2253,165 @@ namespace Secured_Ptr
 
         SecuredPtr& operator=(const SecuredPtr& rhs)
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
-            if (this != &rhs) // Avoid self assignment
+            if (this != std::addressof(rhs)) // Avoid self assignment
             {
-                ClearData(); // Can be called to clear existing files
                 this->swap(rhs);
-                return *this;
+                CopyExpiry(rhs);
             }
+            return *this;
         }
 
-        SecuredPtr& operator=(const SecuredPtr&& rhs) noexcept
+        //Takes over the data of rhs and leaves it empty. '&' handles stay bound to the object they were taken
+        //from: those of rhs write back to rhs, those of this object write back over the moved data.
+        SecuredPtr& operator=(SecuredPtr&& rhs) noexcept
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
-            if (this != &rhs) // Avoid self assignment
+            if (this != std::addressof(rhs)) // Avoid self assignment
             {
-                ClearData();
-                this->swap(rhs);
-                return *this;
+                this->overwriteOnExit = rhs.overwriteOnExit.load();
+                this->deferredSeal = rhs.deferredSeal.load();
+                KeyPin pin;
+                std::shared_ptr<const SecureLazySource> source;
+                SecureBlock* b = AdoptBlock(rhs.TakeBlock(source));
+                rhs.ForgetHandles();
+                ForgetHandles();
+                if (source)
+                    LoadOnFirstUse(std::move(source));
+                else
+                    ReplaceBlock(b);
+#ifdef _ShowDebugVal
+                debugval = std::move(rhs.debugval);
+#endif
             }
+            if (this != std::addressof(rhs))
+            {
+                CopyExpiry(rhs);
+                rhs.CancelExpiry();
+            }
+            return *this;
         }
 
         SecuredPtr& operator=(const T& rhs)
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
-            ClearData();
-            holder.reset();
-            // holder2.reset();
-            internalassign(const_cast<T*>(&rhs));
-            if (protectedData != nullptr)
-            {
-                ProtectMemory(true);
-            }
+            KeyPin pin;
+            ReplaceBlock(CreateBlock(&rhs));
             SetWipeOnExit(true);
+#ifdef _ShowDebugVal
+            GetSharedPtrDebug<T>();
+#endif
             return *this;
         }
 
-        //constant time comparison 
+        //constant time comparison
         bool operator!=(const T& other)
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
             return !(this->operator==(other));
         }
 
-        //constant time comparison 
+        //constant time comparison
         bool operator==(const T& other)
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
-            ProtectMemory(false);
-            volatile byte* thisData = protectedData;
-            PBYTE otherData = nullptr;
-            serialize<T>(other, &otherData);
+            //other is compared in place when its traits expose its bytes, only its length is not hidden
+            size_t otherSize = SizeOf(other);
+            const void* otherData = Traits::Data(other);
+            if (otherData != nullptr || otherSize == 0)
+                return EqualsData(otherData, otherSize);
 
-            if (otherData == nullptr && this->empty())
-                return true;
-
-            if (otherData != nullptr && this->empty())
+            PBYTE temp = AllocateSecure(otherSize);
+            if (temp == nullptr)
                 return false;
+            Traits::Write(other, temp, otherSize);
+            bool result = EqualsData(temp, otherSize);
+            DeallocateSecure(temp, otherSize);
+            return result;
+        }
 
-            if (otherData == nullptr && !this->empty())
-                return false;
 
-            if (dataSize != _msize((void*)otherData))
+        //constant time comparison
+        bool operator==(const SecuredPtr& other) const
+        {
+            SecureBlock* b = PinBlock();
+            SecureBlock* ob = other.PinBlock();
+            if (b == ob) //Same object or copies sharing the data
             {
-                ProtectMemory(true);
-                free((void*)otherData);
-                return false;
+                ReleaseBlock(b);
+                ReleaseBlock(ob);
+                return true;
             }
-            volatile byte result = 0;
-
-            for (int i = 0; i < dataSize; i++)
+            if (b != nullptr && ob != nullptr && b->dataSize == ob->dataSize)
             {
-                result |= thisData[i] ^ otherData[i];
-                if (result == 1)
-                    break;
+                //Both fingerprints known, nothing is decrypted
+                uint64_t fingerprint = b->fingerprint.load(std::memory_order_relaxed);
+                uint64_t otherFingerprint = ob->fingerprint.load(std::memory_order_relaxed);
+                if (fingerprint != 0 && otherFingerprint != 0)
+                {
+                    ReleaseBlock(b);
+                    ReleaseBlock(ob);
+                    return SecureCompare::Equal(&fingerprint, &otherFingerprint, sizeof(fingerprint));
+                }
             }
-            ProtectMemory(true);
-            free((void*)otherData);
-            return result == 0;
-        }
-
-
-        //constant time comparison 
-        bool operator==(SecuredPtr& other)
-        {
-            std::lock_guard<std::recursive_mutex> lg(m);
-            if (dataSize != other.dataSize)
+            if (b == nullptr || ob == nullptr || b->dataSize != ob->dataSize || !OpenBlock(b))
             {
-                ProtectMemory(true);
-                other.ProtectMemory(true);
+                ReleaseBlock(b);
+                ReleaseBlock(ob);
                 return false;
             }
-
-
-            ProtectMemory(false);
-            other.ProtectMemory(false);
-
-            volatile byte* thisData = protectedData;
-            volatile byte* otherData = other.protectedData;
-            volatile byte result = 0;
-
-            for (int i = 0; i < dataSize; i++)
+            if (!OpenBlock(ob))
             {
-                result |= thisData[i] ^ otherData[i];
+                ReleaseRead(b);
+                ReleaseBlock(ob);
+                return false;
             }
-            ProtectMemory(true);
-            other.ProtectMemory(true);
-            return result == 0;
+
+            bool result = SecureCompare::Equal(b->Data(), ob->Data(), b->dataSize);
+            ReleaseRead(b);
+            ReleaseRead(ob);
+            return result;
         }
-        bool operator!=(SecuredPtr& other)
+        bool operator!=(const SecuredPtr& other) const
         {
-            std::lock_guard<std::recursive_mutex> lg(m);
             return !(*this == other);
         }
 
+        //Keyed fingerprint of the data (see SecureFingerprint.h), 0 when empty.
+        //Read from the block when _SecuredFingerprint is defined, else computed from the decrypted data.
+        uint64_t GetFingerprint() const
+        {
+            SecureBlock* b = PinBlock();
+            if (b == nullptr)
+                return 0;
+            uint64_t fingerprint = b->fingerprint.load(std::memory_order_relaxed);
+            if (fingerprint == 0 && OpenBlock(b))
+            {
+                fingerprint = SecureFingerprint::Compute(b->Data(), b->dataSize);
+                CloseBlock(b);
+            }
+            ReleaseBlock(b);
+            return fingerprint;
+        }
+
         bool empty() const {
             if (this == nullptr)
                 return true;
-            return protectedData == nullptr;
+            SpinLock(blockLock);
+            bool result = block.load(std::memory_order_acquire) == nullptr && !lazy;
+            blockLock.clear(std::memory_order_release);
+            return result;
+        }
+    };
+
+    //SecuredPtr keeping values up to 64 bytes (tokens, keys, short passwords) inside the object
+    template <typename T> using SmallSecuredPtr = SecuredPtr<T, DefaultCryptBackend, DefaultSecureAllocator, 64>;
+}
+
+//Hash of the keyed fingerprint so that SecuredPtr can be used in unordered containers
+namespace std
+{
+    template <typename T, typename Backend, typename Allocator, size_t InlineSize>
+    struct hash<Secured_Ptr::SecuredPtr<T, Backend, Allocator, InlineSize>>
+    {
+        size_t operator()(const Secured_Ptr::SecuredPtr<T, Backend, Allocator, InlineSize>& ptr) const
+        {
+            return (size_t)ptr.GetFingerprint();
         }
     };
 }
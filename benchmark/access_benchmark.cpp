@@ -0,0 +1,45 @@
+// Per access cost of operator-> against the access() view.
+// g++ -std=c++17 -O2 -I.. access_benchmark.cpp -o access_benchmark
+
+#include "SecuredPtr.h"
+#include <chrono>
+#include <cstdio>
+
+using namespace Secured_Ptr;
+
+struct Config
+{
+    int flag;
+    double ratio;
+    char name[48];
+};
+
+template <typename F>
+static double NsPerOp(size_t iterations, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        f();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+int main()
+{
+    const size_t iterations = 200000;
+    volatile size_t sink = 0;
+
+    SecuredPtr<std::string> text = std::string(64, 'x');
+    SecuredPtr<Config> config = Config{ 1, 0.5, "config" };
+
+    printf("%-28s %10s\n", "operation", "ns/op");
+    printf("%-28s %10.1f\n", "string operator->",
+        NsPerOp(iterations, [&] { sink += text->size(); }));
+    printf("%-28s %10.1f\n", "string access()",
+        NsPerOp(iterations, [&] { sink += text.access()->size(); }));
+    printf("%-28s %10.1f\n", "struct operator->",
+        NsPerOp(iterations, [&] { sink += config->flag; }));
+    printf("%-28s %10.1f\n", "struct access()",
+        NsPerOp(iterations, [&] { sink += config.access()->flag; }));
+    return sink == 0;
+}
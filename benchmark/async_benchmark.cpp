@@ -0,0 +1,58 @@
+// How long the calling thread is held by operator* and operator= on large strings compared with async_access()
+// and async_assign(), and how long the value takes to be ready with the chunks spread on the worker pool.
+// g++ -std=c++17 -O2 -I.. async_benchmark.cpp -o async_benchmark -lpthread [MB] [threads]
+
+#include "SecuredPtr.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace Secured_Ptr;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Ms(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    size_t mb = argc > 1 ? (size_t)atoi(argv[1]) : 16;
+    size_t threads = argc > 2 ? (size_t)atoi(argv[2]) : 0;
+    SecureWorkerPool::SetPolicy(threads, 64 * 1024, 256 * 1024);
+    std::string value(mb << 20, 's');
+    SecuredPtr<std::string> secret(value);
+    const int rounds = 5;
+
+    for (int r = 0; r < rounds; r++)
+    {
+        auto start = Clock::now();
+        std::string plain = *secret;
+        double sync = Ms(start);
+
+        start = Clock::now();
+        std::future<std::string> pending = secret.async_access();
+        double call = Ms(start);
+        plain = pending.get();
+        double ready = Ms(start);
+        printf("read   %zu MB: operator* holds the caller %7.2f ms | async_access() %6.3f ms, ready after %7.2f ms\n",
+            mb, sync, call, ready);
+    }
+    for (int r = 0; r < rounds; r++)
+    {
+        auto start = Clock::now();
+        secret = value;
+        double sync = Ms(start);
+
+        std::string copy = value;
+        start = Clock::now();
+        std::future<void> pending = secret.async_assign(std::move(copy));
+        double call = Ms(start);
+        pending.get();
+        double ready = Ms(start);
+        printf("assign %zu MB: operator= holds the caller %7.2f ms | async_assign() %6.3f ms, ready after %7.2f ms\n",
+            mb, sync, call, ready);
+    }
+    return (*secret).size() == value.size() ? 0 : 1;
+}
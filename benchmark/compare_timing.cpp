@@ -0,0 +1,97 @@
+// Checks that the constant time comparison does not depend on the position of the first mismatching byte.
+// Times SecureCompare::Equal and SecuredPtr::operator== with the mismatch at the first, middle and last byte
+// and without mismatch over many turns, and fails when the median times of the fastest and slowest case differ
+// by more than the tolerance.
+// g++ -std=c++17 -O2 -I.. compare_timing.cpp -o compare_timing [tolerance percent, default 25]
+
+#include "SecuredPtr.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace Secured_Ptr;
+
+template <typename F>
+static double NsPerOp(size_t iterations, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        f();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+//Median of values, reorders them
+static double Median(std::vector<double>& values)
+{
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+//Times cmp(candidate) for every mismatch position and returns the spread between fastest and slowest in percent.
+//A turn times every position once, starting at a different one each turn so that no position always follows the
+//same one. Each time is taken relative to the mean of its turn, which cancels clock and frequency changes between
+//turns, and the spread is computed from the median of those ratios over the turns, not from single runs.
+template <typename F>
+static double Measure(const char* name, size_t size, size_t iterations, F&& cmp)
+{
+    const int turns = 101;
+    const size_t positions[] = { 0, size / 2, size - 1, size };
+    const char* labels[] = { "first", "middle", "last", "none" };
+    std::vector<double> times[4];
+    std::vector<double> ratios[4];
+    std::string candidate(size, 'k');
+    volatile size_t sink = 0;
+    for (int turn = 0; turn < turns; turn++)
+    {
+        double turnTimes[4];
+        for (int n = 0; n < 4; n++)
+        {
+            int p = (turn + n) % 4;
+            if (positions[p] < size)
+                candidate[positions[p]] = 'x';
+            turnTimes[p] = NsPerOp(iterations, [&] { sink += cmp(candidate); });
+            if (positions[p] < size)
+                candidate[positions[p]] = 'k';
+        }
+        double mean = (turnTimes[0] + turnTimes[1] + turnTimes[2] + turnTimes[3]) / 4;
+        for (int p = 0; p < 4; p++)
+        {
+            times[p].push_back(turnTimes[p]);
+            ratios[p].push_back(turnTimes[p] / mean);
+        }
+    }
+    double medians[4];
+    for (int p = 0; p < 4; p++)
+    {
+        medians[p] = Median(ratios[p]);
+        printf("%-22s %6zu %-8s %12.1f\n", name, size, labels[p], Median(times[p]));
+    }
+    double fastest = *std::min_element(medians, medians + 4);
+    double slowest = *std::max_element(medians, medians + 4);
+    return (slowest - fastest) * 100.0 / fastest;
+}
+
+int main(int argc, char** argv)
+{
+    double tolerance = argc > 1 ? atof(argv[1]) : 25.0;
+    printf("kernel: %s\n", SecureCompare::KernelName());
+    printf("%-22s %6s %-8s %12s\n", "comparison", "bytes", "mismatch", "median ns/op");
+
+    double worst = 0;
+    for (size_t size : { 33, 1024, 4096 })
+    {
+        std::string stored(size, 'k');
+        worst = std::max(worst, Measure("SecureCompare::Equal", size, 1000000 / size + 100,
+            [&](const std::string& candidate) { return SecureCompare::Equal(stored.data(), candidate.data(), size); }));
+    }
+    SecuredPtr<std::string> secret = std::string(64, 'k');
+    worst = std::max(worst, Measure("SecuredPtr::operator==", 64, 2000,
+        [&](const std::string& candidate) { return secret == candidate; }));
+
+    printf("largest spread %.1f%% (tolerance %.1f%%)\n", worst, tolerance);
+    return worst <= tolerance ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+// Throughput of concurrent readers of one SecuredPtr from 1 to N threads.
+// g++ -std=c++17 -O2 -pthread -I.. concurrency_benchmark.cpp -o concurrency_benchmark [max threads]
+
+#include "SecuredPtr.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace Secured_Ptr;
+
+template <typename F>
+static double NsPerOp(unsigned threads, size_t iterations, F f)
+{
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; t++)
+        workers.emplace_back([&] {
+            for (size_t i = 0; i < iterations; i++)
+                f();
+        });
+    for (auto& worker : workers)
+        worker.join();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (iterations * threads);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned maxThreads = argc > 1 ? (unsigned)atoi(argv[1]) : std::thread::hardware_concurrency() * 2;
+    const size_t iterations = 50000;
+    SecuredPtr<std::string> apiKey = std::string("0123456789abcdef0123456789abcdef");
+    std::atomic<size_t> sink{ 0 };
+
+    printf("%8s %16s %16s %16s\n", "threads", "access() ns/op", "operator* ns/op", "operator== ns/op");
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2)
+    {
+        double view = NsPerOp(threads, iterations, [&] { sink += apiKey.access()->size(); });
+        double copy = NsPerOp(threads, iterations, [&] { sink += (*apiKey).size(); });
+        double compare = NsPerOp(threads, iterations, [&] { sink += apiKey == std::string("0123456789abcdef0123456789abcdef"); });
+        printf("%8u %16.1f %16.1f %16.1f\n", threads, view, copy, compare);
+    }
+    return sink == 0;
+}
@@ -0,0 +1,59 @@
+// Cost of copying and moving a SecuredPtr that holds a 4 KB secret, the copies share one encrypted buffer.
+// Also counts the secure allocations made while a std::vector of SecuredPtr grows.
+// g++ -std=c++17 -O2 -I.. copy_benchmark.cpp -o copy_benchmark
+
+#include "SecuredPtr.h"
+#include <chrono>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+using namespace Secured_Ptr;
+
+template <typename F>
+static double NsPerOp(size_t iterations, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        f();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+static size_t PassByValue(SecuredPtr<std::string> secret)
+{
+    return secret.GetSize();
+}
+
+int main()
+{
+    const size_t iterations = 200000;
+    volatile size_t sink = 0;
+
+    SecuredPtr<std::string> certificate = std::string(4096, 'c');
+    SecuredPtr<std::string> target;
+
+    printf("%-28s %10s\n", "operation", "ns/op");
+    printf("%-28s %10.1f\n", "copy construct",
+        NsPerOp(iterations, [&] { SecuredPtr<std::string> copy(certificate); sink += copy.empty(); }));
+    printf("%-28s %10.1f\n", "copy assign",
+        NsPerOp(iterations, [&] { target = certificate; }));
+    printf("%-28s %10.1f\n", "pass by value",
+        NsPerOp(iterations, [&] { sink += PassByValue(certificate); }));
+    printf("%-28s %10.1f\n", "assign new value",
+        NsPerOp(iterations / 10, [&] { target = std::string(4096, 'd'); }));
+    printf("%-28s %10.1f\n", "move construct",
+        NsPerOp(iterations, [&] { SecuredPtr<std::string> moved(std::move(target)); target = std::move(moved); }));
+
+#ifndef _WIN32
+    //Growth moves the elements so only the secrets themselves are allocated
+    const size_t count = 1000;
+    std::vector<SecuredPtr<std::string>> secrets;
+    size_t before = SecureArenaAllocator::GetStats().allocations;
+    for (size_t i = 0; i < count; i++)
+        secrets.push_back(SecuredPtr<std::string>(std::string(32, 's')));
+    size_t allocations = SecureArenaAllocator::GetStats().allocations - before;
+    printf("%-28s %10.2f\n", "vector growth allocs/elem", (double)(allocations - count) / count);
+#endif
+    return sink == 0;
+}
@@ -0,0 +1,72 @@
+// Hot loop of '->' accesses to a SecuredPtr struct with and without deferred sealing: ns and crypto calls
+// per access, and how long the data stayed decrypted after the loop before the sealer encrypted it.
+// g++ -std=c++17 -O2 -I.. deferred_seal_benchmark.cpp -o deferred_seal_benchmark -lpthread
+
+#include "SecuredPtr.h"
+#include <chrono>
+#include <cstdio>
+
+using namespace Secured_Ptr;
+
+//Default backend counting its calls
+class CountingBackend
+{
+public:
+    static constexpr size_t BlockSize = DefaultCryptBackend::BlockSize;
+    static std::atomic<size_t> calls;
+
+    static constexpr size_t GetBlockSize(size_t dataSize)
+    {
+        return DefaultCryptBackend::GetBlockSize(dataSize);
+    }
+
+    static bool Protect(PBYTE data, size_t dataBlockSize)
+    {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return DefaultCryptBackend::Protect(data, dataBlockSize);
+    }
+
+    static bool Unprotect(PBYTE data, size_t dataBlockSize)
+    {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return DefaultCryptBackend::Unprotect(data, dataBlockSize);
+    }
+};
+std::atomic<size_t> CountingBackend::calls{ 0 };
+
+struct Session
+{
+    int id;
+    char key[60];
+};
+
+static void Run(const char* name, bool deferred)
+{
+    const size_t iterations = 100000;
+    volatile int sink = 0;
+    SecuredPtr<Session, CountingBackend> session(Session{ 1, {} });
+    session.SetDeferredSeal(deferred);
+
+    size_t calls = CountingBackend::calls.load();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        sink += session->id;
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    double perOp = (double)(CountingBackend::calls.load() - calls) / iterations;
+
+    while (!session.IsProtected())
+        std::this_thread::yield();
+    double exposure = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - end).count();
+    printf("%-10s %10.1f %12.3f %14.0f\n", name, ns, perOp, exposure);
+}
+
+int main()
+{
+    SecureSealer::SetPolicy(std::chrono::microseconds(1000), 256);
+    printf("window %lld us, %u accesses\n", (long long)SecureSealer::GetWindow().count(), SecureSealer::GetMaxAccesses());
+    printf("%-10s %10s %12s %14s\n", "sealing", "ns/op", "crypto/op", "sealed after us");
+    Run("immediate", false);
+    Run("deferred", true);
+    return 0;
+}
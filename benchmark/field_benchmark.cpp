@@ -0,0 +1,43 @@
+// Reading and writing one int flag of a 512 byte struct with get<>()/set<>() against '->' and access(),
+// which decrypt and re-encrypt the whole struct.
+// g++ -std=c++17 -O2 -I.. field_benchmark.cpp -o field_benchmark
+
+#include "SecuredPtr.h"
+#include <chrono>
+#include <cstdio>
+
+using namespace Secured_Ptr;
+
+struct Config
+{
+    char header[200];
+    int flag;
+    char body[308];
+};
+
+template <typename F>
+static double NsPerOp(size_t iterations, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        f();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+int main()
+{
+    const size_t iterations = 100000;
+    volatile int sink = 0;
+    Config config{};
+    config.flag = 1;
+    SecuredPtr<Config> ptr(config);
+
+    printf("%-22s %10s\n", "operation", "ns/op");
+    printf("%-22s %10.1f\n", "get<&Config::flag>", NsPerOp(iterations, [&] { sink += ptr.get<&Config::flag>(); }));
+    printf("%-22s %10.1f\n", "access()->flag", NsPerOp(iterations, [&] { sink += ptr.access()->flag; }));
+    printf("%-22s %10.1f\n", "->flag", NsPerOp(iterations, [&] { sink += ptr->flag; }));
+    printf("%-22s %10.1f\n", "set<&Config::flag>", NsPerOp(iterations, [&] { ptr.set<&Config::flag>(2); }));
+    printf("%-22s %10.1f\n", "access()->flag =", NsPerOp(iterations, [&] { ptr.access()->flag = 2; }));
+    return 0;
+}
@@ -0,0 +1,69 @@
+// Lookups of SecuredPtr secrets in an std::unordered_set of 100k entries, with the crypto calls they make.
+// Build it with and without -D_SecuredFingerprint to compare:
+// g++ -std=c++17 -O2 -D_SecuredFingerprint -I.. fingerprint_benchmark.cpp -o fingerprint_benchmark
+
+#include "SecuredPtr.h"
+#include <chrono>
+#include <cstdio>
+#include <unordered_set>
+
+using namespace Secured_Ptr;
+
+//Default backend counting its calls
+class CountingBackend
+{
+public:
+    static constexpr size_t BlockSize = DefaultCryptBackend::BlockSize;
+    static std::atomic<size_t> calls;
+
+    static constexpr size_t GetBlockSize(size_t dataSize)
+    {
+        return DefaultCryptBackend::GetBlockSize(dataSize);
+    }
+
+    static bool Protect(PBYTE data, size_t dataBlockSize)
+    {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return DefaultCryptBackend::Protect(data, dataBlockSize);
+    }
+
+    static bool Unprotect(PBYTE data, size_t dataBlockSize)
+    {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return DefaultCryptBackend::Unprotect(data, dataBlockSize);
+    }
+};
+std::atomic<size_t> CountingBackend::calls{ 0 };
+
+typedef SecuredPtr<std::string, CountingBackend> Secret;
+
+int main()
+{
+    const size_t count = 100000;
+    const size_t lookups = 20000;
+
+    std::unordered_set<Secret> secrets;
+    secrets.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        secrets.insert(Secret(std::string("secret-") + std::to_string(i)));
+
+    Secret hit = std::string("secret-4242");
+    Secret miss = std::string("not-a-secret");
+    size_t found = 0;
+    size_t callsBefore = CountingBackend::calls.load();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; i++)
+        found += secrets.count(i % 2 ? hit : miss);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    size_t calls = CountingBackend::calls.load() - callsBefore;
+
+#ifdef _SecuredFingerprint
+    printf("fingerprints: on\n");
+#else
+    printf("fingerprints: off\n");
+#endif
+    printf("%-20s %10s %14s\n", "operation", "ns/op", "crypto/op");
+    printf("%-20s %10.1f %14.2f\n", "set lookup",
+        std::chrono::duration<double, std::nano>(elapsed).count() / lookups, (double)calls / lookups);
+    return found == lookups / 2 ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+// Assignment and access latency of short secrets with and without the inline small buffer (64 bytes).
+// g++ -std=c++17 -O2 -I.. inline_benchmark.cpp -o inline_benchmark
+
+#include "SecuredPtr.h"
+#include <chrono>
+#include <cstdio>
+
+using namespace Secured_Ptr;
+
+template <typename F>
+static double NsPerOp(size_t iterations, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        f();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+template <typename Ptr>
+static void Run(const char* name, size_t size)
+{
+    const size_t iterations = 100000;
+    volatile size_t sink = 0;
+    std::string secret(size, 's');
+    Ptr ptr;
+
+    double assign = NsPerOp(iterations, [&] { ptr = secret; });
+    double access = NsPerOp(iterations, [&] { sink += ptr.access()->size(); });
+    printf("%-10s %6zu %12.1f %12.1f\n", name, size, assign, access);
+}
+
+int main()
+{
+    printf("%-10s %6s %12s %12s\n", "storage", "bytes", "assign ns", "access ns");
+    for (size_t size : { 16, 32, 64, 128, 256 })
+    {
+        Run<SecuredPtr<std::string>>("heap", size);
+        Run<SmallSecuredPtr<std::string>>("inline(64)", size);
+    }
+    return 0;
+}
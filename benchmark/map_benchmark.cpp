@@ -0,0 +1,82 @@
+// Looks up the credentials of 100000 tenants by tenant id in a SecuredMap and in the std::map and std::unordered_map
+// of SecuredPtr it replaces (whose tenant ids stay in clear), then measures insert and erase.
+// g++ -std=c++17 -O2 -I.. map_benchmark.cpp -o map_benchmark -lpthread [tenants] [lookups]
+
+#include "SecuredMap.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+using namespace Secured_Ptr;
+
+typedef std::chrono::steady_clock Clock;
+
+static double NsPer(Clock::time_point start, size_t ops)
+{
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (double)ops;
+}
+
+int main(int argc, char** argv)
+{
+    size_t tenants = argc > 1 ? (size_t)atoi(argv[1]) : 100000;
+    size_t lookups = argc > 2 ? (size_t)atoi(argv[2]) : 1000000;
+    std::vector<std::string> ids;
+    for (size_t i = 0; i < tenants; i++)
+        ids.push_back("tenant-" + std::to_string(i * 2654435761u % 1000000007u));
+    std::string credential(48, 'c');
+    std::vector<size_t> order(lookups);
+    uint64_t n = 1;
+    for (size_t& i : order)
+    {
+        n = n * 6364136223846793005ULL + 1442695040888963407ULL;
+        i = (size_t)(n >> 33) % tenants;
+    }
+
+    auto start = Clock::now();
+    std::map<std::string, SecuredPtr<std::string>> ordered;
+    for (const std::string& id : ids)
+        ordered.emplace(id, SecuredPtr<std::string>(credential));
+    printf("%-44s insert %7.1f ns", "std::map<string, SecuredPtr<string>>", NsPer(start, tenants));
+    size_t bytes = 0;
+    start = Clock::now();
+    for (size_t i : order)
+        bytes += (*ordered[ids[i]]).size();
+    printf("  lookup %7.1f ns\n", NsPer(start, lookups));
+
+    start = Clock::now();
+    std::unordered_map<std::string, SecuredPtr<std::string>> hashed;
+    for (const std::string& id : ids)
+        hashed.emplace(id, SecuredPtr<std::string>(credential));
+    printf("%-44s insert %7.1f ns", "std::unordered_map<string, SecuredPtr<string>>", NsPer(start, tenants));
+    start = Clock::now();
+    for (size_t i : order)
+        bytes += (*hashed[ids[i]]).size();
+    printf("  lookup %7.1f ns\n", NsPer(start, lookups));
+
+    start = Clock::now();
+    SecuredMap<std::string, std::string> map;
+    for (const std::string& id : ids)
+        map.Insert(id, credential);
+    printf("%-44s insert %7.1f ns", "SecuredMap<string, string>", NsPer(start, tenants));
+    std::string value;
+    start = Clock::now();
+    for (size_t i : order)
+    {
+        map.Get(ids[i], value);
+        bytes += value.size();
+    }
+    printf("  lookup %7.1f ns", NsPer(start, lookups));
+    start = Clock::now();
+    for (size_t i : order)
+        map.Visit(ids[i], [&bytes](std::string_view view) { bytes += view.size(); });
+    printf("  Visit %7.1f ns\n", NsPer(start, lookups));
+
+    start = Clock::now();
+    for (const std::string& id : ids)
+        map.Erase(id);
+    printf("SecuredMap erase %.1f ns, %zu left, %zu bytes checked\n", NsPer(start, tenants), map.Count(), bytes);
+    return 0;
+}
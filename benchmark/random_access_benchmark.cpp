@@ -0,0 +1,42 @@
+// Cost of reading and writing 256 bytes of a large SecuredPtr<std::string> with Read()/Write()
+// against access(), which decrypts and re-encrypts the whole payload. Write() re-encrypts the whole
+// payload too, under a fresh nonce, but never has more than one chunk of it in clear.
+// g++ -std=c++17 -O2 -I.. random_access_benchmark.cpp -o random_access_benchmark
+
+#include "SecuredPtr.h"
+#include <chrono>
+#include <cstdio>
+
+using namespace Secured_Ptr;
+
+template <typename F>
+static double NsPerOp(size_t iterations, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        f();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+int main()
+{
+    const size_t len = 256;
+    BYTE buffer[len] = {};
+    volatile size_t sink = 0;
+    printf("%10s %14s %14s %14s %14s\n", "payload", "Read ns", "access ns", "Write ns", "access rw ns");
+    for (size_t size : { 4096, 65536, 1 << 20, 16 << 20 })
+    {
+        SecuredPtr<std::string> ptr(std::string(size, 'k'));
+        size_t iterations = size >= (1 << 20) ? 20 : 2000;
+        size_t offset = 0;
+        auto next = [&] { offset = (offset + 7919 * len) % (size - len); };
+
+        double read = NsPerOp(iterations, [&] { next(); ptr.Read(offset, len, buffer); sink += buffer[0]; });
+        double access = NsPerOp(iterations, [&] { next(); auto v = ptr.access(); memcpy(buffer, v->data() + offset, len); sink += buffer[0]; });
+        double write = NsPerOp(iterations, [&] { next(); ptr.Write(offset, buffer, len); });
+        double accessWrite = NsPerOp(iterations, [&] { next(); auto v = &ptr; memcpy(&(*v)[offset], buffer, len); });
+        printf("%10zu %14.0f %14.0f %14.0f %14.0f\n", size, read, access, write, accessWrite);
+    }
+    return 0;
+}
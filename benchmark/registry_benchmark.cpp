@@ -0,0 +1,88 @@
+// Rotates the key of 100000 live secrets with SecureRegistry::Rekey() while reader threads keep dereferencing them,
+// then wipes them all. Prints the rotation time and the read latency seen during and outside the rotation.
+// g++ -std=c++17 -O2 -D_SecuredRegistry -I.. registry_benchmark.cpp -o registry_benchmark -lpthread [secrets] [readers] [walkers]
+
+#include "SecuredPtr.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace Secured_Ptr;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Ms(Clock::duration d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+int main(int argc, char** argv)
+{
+#ifndef _SecuredRegistry
+    printf("built without _SecuredRegistry, nothing to rotate\n");
+    return 0;
+#endif
+    size_t count = argc > 1 ? (size_t)atoi(argv[1]) : 100000;
+    size_t readers = argc > 2 ? (size_t)atoi(argv[2]) : 2;
+    size_t walkers = argc > 3 ? (size_t)atoi(argv[3]) : 0;
+
+    auto start = Clock::now();
+    std::vector<std::unique_ptr<SecuredPtr<std::string>>> secrets;
+    secrets.reserve(count);
+    for (size_t i = 0; i < count; i++)
+        secrets.emplace_back(new SecuredPtr<std::string>(std::string("secret-") + std::to_string(i)));
+    printf("%zu secrets created in %.1f ms, %zu registered\n", count, Ms(Clock::now() - start), SecureRegistry::Count());
+
+    //Readers record their worst read, rotating tells them which bucket it goes to
+    std::atomic<bool> stop{ false };
+    std::atomic<bool> rotating{ false };
+    std::atomic<uint64_t> reads{ 0 };
+    std::atomic<uint64_t> worstNs[2] = {};
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < readers; t++)
+        threads.emplace_back([&, t] {
+            uint64_t n = t + 1;
+            volatile size_t sink = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                n = n * 6364136223846793005ULL + 1442695040888963407ULL;
+                bool during = rotating.load(std::memory_order_relaxed);
+                auto begin = Clock::now();
+                sink += (**secrets[(size_t)(n >> 33) % count]).size();
+                uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count();
+                uint64_t worst = worstNs[during].load(std::memory_order_relaxed);
+                while (ns > worst && !worstNs[during].compare_exchange_weak(worst, ns, std::memory_order_relaxed))
+                    ;
+                reads.fetch_add(1, std::memory_order_relaxed);
+            }
+            });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    for (int round = 0; round < 3; round++)
+    {
+        uint64_t readsBefore = reads.load();
+        rotating = true;
+        start = Clock::now();
+        SecureRegistryResult result = SecureRegistry::Rekey(walkers);
+        double ms = Ms(Clock::now() - start);
+        rotating = false;
+        printf("rekey %d: %.1f ms (%.0f ns per secret), visited %zu, failed %zu, rotated %s, %llu reads meanwhile\n", round,
+            ms, ms * 1e6 / std::max<size_t>(result.visited, 1), result.visited, result.failed, result.rotated ? "yes" : "no",
+            (unsigned long long)(reads.load() - readsBefore));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    stop = true;
+    for (std::thread& t : threads)
+        t.join();
+    printf("worst read: %.1f us outside rotations, %.1f us during them\n", worstNs[0].load() / 1e3, worstNs[1].load() / 1e3);
+
+    start = Clock::now();
+    SecureRegistryResult wiped = SecureRegistry::WipeAll(walkers);
+    printf("wipe all: %.1f ms, visited %zu\n", Ms(Clock::now() - start), wiped.visited);
+    return 0;
+}
@@ -0,0 +1,70 @@
+// Saves 50000 secrets in a sealed file, then measures the cold start: opening the file and attaching every entry to
+// a SecuredPtr, followed by the first use of some of them. Only the entries used are decrypted, so the time should
+// follow the number used and not the number in the file. Loading them all is the eager baseline.
+// g++ -std=c++17 -O2 -I.. sealed_file_benchmark.cpp -o sealed_file_benchmark -lpthread [secrets] [path]
+
+#include "SecureFile.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace Secured_Ptr;
+
+typedef std::chrono::steady_clock Clock;
+
+static double Ms(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? (size_t)atoi(argv[1]) : 50000;
+    const char* path = argc > 2 ? argv[2] : "sealed_file_benchmark.sealed";
+    BYTE wrappingKey[32];
+    for (size_t i = 0; i < sizeof(wrappingKey); i++)
+        wrappingKey[i] = (BYTE)(i * 31 + 7);
+
+    auto start = Clock::now();
+    {
+        SecureFileWriter writer(wrappingKey);
+        for (size_t i = 0; i < count; i++)
+        {
+            SecuredPtr<std::string> secret(std::string("api-token-") + std::to_string(i) + std::string(48, 't'));
+            if (writer.Add(secret) != i)
+                return 1;
+        }
+        if (!writer.Save(path))
+        {
+            printf("cannot write %s\n", path);
+            return 1;
+        }
+    }
+    printf("%zu secrets sealed in %.1f ms\n", count, Ms(start));
+
+    size_t used[] = { 0, 10, 100, 1000, count };
+    for (size_t n : used)
+    {
+        if (n > count)
+            continue;
+        start = Clock::now();
+        SecureFile file;
+        if (!file.Open(path, wrappingKey))
+            return 1;
+        double open = Ms(start);
+        std::vector<SecuredPtr<std::string>> secrets(file.Count());
+        for (size_t i = 0; i < secrets.size(); i++)
+            file.Get(i, secrets[i]);
+        double attached = Ms(start);
+        size_t bytes = 0;
+        for (size_t i = 0; i < n; i++)
+            bytes += (*secrets[i * (count / n)]).size();
+        double ready = Ms(start);
+        printf("use %6zu of %zu: open %6.3f ms, entries attached %7.2f ms, used %7.2f ms (%zu bytes)\n",
+            n, count, open, attached, ready, bytes);
+    }
+    remove(path);
+    return 0;
+}
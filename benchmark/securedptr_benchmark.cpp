@@ -0,0 +1,385 @@
+// Benchmark suite of the SecuredPtr operations, machine readable.
+// Every operation is run on std::string, std::wstring and POD structs for payloads from 8 bytes to 16 MB,
+// and the operations that share one SecuredPtr between threads for every thread count asked for.
+// Each line gives ns/op, secure allocations/op, heap allocations/op and crypto calls/op.
+//
+// securedptr_benchmark [--format=csv|json] [--filter=op] [--type=string|wstring|pod] [--max-size=bytes]
+//                      [--threads=1,2,4] [--min-time-ms=10] [--output=file]
+// Built by the securedptr_benchmark CMake target (run_securedptr_benchmark writes securedptr_benchmark.csv), or:
+// g++ -std=c++17 -O2 -I.. securedptr_benchmark.cpp -o securedptr_benchmark -lpthread
+
+#include "SecuredPtr.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Secured_Ptr;
+
+//Heap allocations of the whole process, counted by the replaced global operator new.
+//Every form is replaced, plain, array, nothrow and aligned, so that each allocation is counted once and
+//every block is released by the free() matching the malloc() that returned it.
+static std::atomic<size_t> heapAllocations{ 0 };
+
+static void* CountedAlloc(size_t size, size_t alignment) noexcept
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0)
+        size = 1;
+    if (alignment <= alignof(std::max_align_t))
+        return malloc(size);
+    void* p = nullptr;
+    return posix_memalign(&p, alignment, size) == 0 ? p : nullptr;
+}
+
+static void* CountedNew(size_t size, size_t alignment)
+{
+    void* p = CountedAlloc(size, alignment);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size) { return CountedNew(size, 0); }
+void* operator new[](size_t size) { return CountedNew(size, 0); }
+void* operator new(size_t size, std::align_val_t al) { return CountedNew(size, (size_t)al); }
+void* operator new[](size_t size, std::align_val_t al) { return CountedNew(size, (size_t)al); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size, 0); }
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return CountedAlloc(size, (size_t)al); }
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept { return CountedAlloc(size, (size_t)al); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { free(p); }
+
+//Default backend counting its calls
+class CountingBackend
+{
+public:
+    static constexpr size_t BlockSize = DefaultCryptBackend::BlockSize;
+    static std::atomic<size_t> calls;
+
+    static constexpr size_t GetBlockSize(size_t dataSize)
+    {
+        return DefaultCryptBackend::GetBlockSize(dataSize);
+    }
+
+    static bool Protect(PBYTE data, size_t dataBlockSize)
+    {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return DefaultCryptBackend::Protect(data, dataBlockSize);
+    }
+
+    static bool Unprotect(PBYTE data, size_t dataBlockSize)
+    {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return DefaultCryptBackend::Unprotect(data, dataBlockSize);
+    }
+};
+std::atomic<size_t> CountingBackend::calls{ 0 };
+
+//Default allocator counting the secure buffers it hands out
+class CountingAllocator
+{
+public:
+    static std::atomic<size_t> allocations;
+
+    static PBYTE Allocate(size_t size)
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return DefaultSecureAllocator::Allocate(size);
+    }
+
+    static void Deallocate(PBYTE ptr, size_t size)
+    {
+        DefaultSecureAllocator::Deallocate(ptr, size);
+    }
+};
+std::atomic<size_t> CountingAllocator::allocations{ 0 };
+
+template <size_t N> struct Pod
+{
+    char bytes[N];
+};
+
+//Payload of about size bytes and a cheap use of a decrypted value, per type
+static void MakeValue(std::string& value, size_t size) { value.assign(size, 's'); }
+static void MakeValue(std::wstring& value, size_t size) { value.assign(std::max<size_t>(size / sizeof(wchar_t), 1), L's'); }
+template <size_t N> static void MakeValue(Pod<N>& value, size_t) { memset(value.bytes, 's', N); }
+
+static size_t Touch(const std::string& value) { return value.size(); }
+static size_t Touch(const std::wstring& value) { return value.size(); }
+template <size_t N> static size_t Touch(const Pod<N>& value) { return (size_t)value.bytes[0]; }
+
+struct Options
+{
+    bool json = false;
+    std::string filter;
+    std::string type;
+    size_t maxSize = 16 << 20;
+    std::vector<size_t> threads{ 1 };
+    double minTimeMs = 10;
+    std::string output;
+};
+
+struct Result
+{
+    size_t iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double heapAllocsPerOp;
+    double cryptoPerOp;
+};
+
+static volatile size_t sink = 0;
+
+//Runs op(thread) iterations times on each thread. With a setup, setup(thread) runs untimed before every op.
+static Result Measure(size_t iterations, size_t threads, const std::function<void(size_t)>& op,
+    const std::function<void(size_t)>& setup)
+{
+    std::atomic<size_t> ready{ 0 };
+    std::atomic<bool> go{ false };
+    std::vector<double> threadNs(threads, 0);
+    std::vector<size_t> untimedAllocs(threads, 0), untimedHeap(threads, 0), untimedCrypto(threads, 0);
+
+    auto body = [&](size_t t) {
+        ready++;
+        while (!go.load())
+            std::this_thread::yield();
+        if (!setup)
+            return;
+        //Only the op is timed and counted, one iteration at a time
+        double ns = 0;
+        for (size_t i = 0; i < iterations; i++)
+        {
+            size_t a = CountingAllocator::allocations.load(), h = heapAllocations.load(), c = CountingBackend::calls.load();
+            setup(t);
+            untimedAllocs[t] += CountingAllocator::allocations.load() - a;
+            untimedHeap[t] += heapAllocations.load() - h;
+            untimedCrypto[t] += CountingBackend::calls.load() - c;
+            auto start = std::chrono::steady_clock::now();
+            op(t);
+            ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        }
+        threadNs[t] = ns;
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threads; t++)
+        workers.emplace_back([&, t] {
+            body(t);
+            if (!setup)
+                for (size_t i = 0; i < iterations; i++)
+                    op(t);
+            });
+    while (ready.load() < threads - 1)
+        std::this_thread::yield();
+
+    size_t allocs = CountingAllocator::allocations.load();
+    size_t heap = heapAllocations.load();
+    size_t crypto = CountingBackend::calls.load();
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    body(0);
+    if (!setup)
+        for (size_t i = 0; i < iterations; i++)
+            op(0);
+    for (std::thread& w : workers)
+        w.join();
+    double wallNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+    size_t ops = iterations * threads;
+    size_t skipAllocs = 0, skipHeap = 0, skipCrypto = 0;
+    double timedNs = 0;
+    for (size_t t = 0; t < threads; t++)
+    {
+        skipAllocs += untimedAllocs[t];
+        skipHeap += untimedHeap[t];
+        skipCrypto += untimedCrypto[t];
+        timedNs += threadNs[t];
+    }
+    Result r;
+    r.iterations = iterations;
+    //Latency of one op on one thread
+    r.nsPerOp = setup ? timedNs / ops : wallNs / iterations;
+    //The threads are started before the counters are read, only the measured ops count
+    r.allocsPerOp = (double)(CountingAllocator::allocations.load() - allocs - skipAllocs) / ops;
+    r.heapAllocsPerOp = (double)(heapAllocations.load() - heap - skipHeap) / ops;
+    r.cryptoPerOp = (double)(CountingBackend::calls.load() - crypto - skipCrypto) / ops;
+    return r;
+}
+
+//Doubles the iterations till one run lasts minTimeMs, then reports that run
+static Result Calibrate(const Options& options, size_t threads, const std::function<void(size_t)>& op,
+    const std::function<void(size_t)>& setup = nullptr)
+{
+    size_t iterations = 1;
+    for (;;)
+    {
+        auto start = std::chrono::steady_clock::now();
+        Result r = Measure(iterations, threads, op, setup);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (ms >= options.minTimeMs || iterations >= (1u << 24))
+            return r;
+        iterations *= ms > 0 ? std::min<size_t>(std::max<size_t>((size_t)(options.minTimeMs / ms), 2), 100) : 100;
+    }
+}
+
+static void Print(const Options& options, const char* op, const char* type, size_t bytes, size_t threads, const Result& r)
+{
+    if (options.json)
+        printf("{\"op\":\"%s\",\"type\":\"%s\",\"bytes\":%zu,\"threads\":%zu,\"iterations\":%zu,"
+            "\"ns_per_op\":%.1f,\"allocs_per_op\":%.3f,\"heap_allocs_per_op\":%.3f,\"crypto_calls_per_op\":%.3f}\n",
+            op, type, bytes, threads, r.iterations, r.nsPerOp, r.allocsPerOp, r.heapAllocsPerOp, r.cryptoPerOp);
+    else
+        printf("%s,%s,%zu,%zu,%zu,%.1f,%.3f,%.3f,%.3f\n",
+            op, type, bytes, threads, r.iterations, r.nsPerOp, r.allocsPerOp, r.heapAllocsPerOp, r.cryptoPerOp);
+    fflush(stdout);
+}
+
+template <typename T>
+static void RunType(const Options& options, const char* type, size_t bytes)
+{
+    typedef SecuredPtr<T, CountingBackend, CountingAllocator> Secret;
+    if (!options.type.empty() && options.type != type)
+        return;
+    auto selected = [&](const char* op) { return options.filter.empty() || options.filter == op; };
+
+    T value{};
+    MakeValue(value, bytes);
+
+    //Operations on a SecuredPtr of the thread
+    if (selected("construct"))
+        Print(options, "construct", type, bytes, 1, Calibrate(options, 1, [&](size_t) { Secret p(value); sink += p.empty(); }));
+    if (selected("copy"))
+    {
+        Secret source(value);
+        Print(options, "copy", type, bytes, 1, Calibrate(options, 1, [&](size_t) { Secret c(source); sink += c.empty(); }));
+    }
+    if (selected("clear"))
+    {
+        Secret p;
+        Print(options, "clear", type, bytes, 1, Calibrate(options, 1, [&](size_t) { p.ClearData(); }, [&](size_t) { p = value; }));
+    }
+    if (selected("amp_held"))
+    {
+        Secret p(value);
+        auto handle = &p;
+        Print(options, "amp_held", type, bytes, 1, Calibrate(options, 1, [&](size_t) { sink += Touch(*handle); }));
+    }
+
+    //Operations on one SecuredPtr shared by all the threads
+    for (size_t threads : options.threads)
+    {
+        Secret shared(value);
+        Secret other(value);
+        if (selected("assign"))
+            Print(options, "assign", type, bytes, threads, Calibrate(options, threads, [&](size_t) { shared = value; }));
+        if (selected("arrow"))
+            Print(options, "arrow", type, bytes, threads, Calibrate(options, threads, [&](size_t) { sink += Touch(*shared.operator->()); }));
+        if (selected("amp_released"))
+            Print(options, "amp_released", type, bytes, threads, Calibrate(options, threads, [&](size_t) { auto h = &shared; sink += Touch(*h); }));
+        if (selected("deref"))
+            Print(options, "deref", type, bytes, threads, Calibrate(options, threads, [&](size_t) { T v = *shared; sink += Touch(v); }));
+        if (selected("eq_value"))
+            Print(options, "eq_value", type, bytes, threads, Calibrate(options, threads, [&](size_t) { sink += shared == value; }));
+        if (selected("eq_ptr"))
+            Print(options, "eq_ptr", type, bytes, threads, Calibrate(options, threads, [&](size_t) { sink += shared == other; }));
+    }
+}
+
+template <size_t N>
+static void RunPod(const Options& options)
+{
+    if (N <= options.maxSize)
+        RunType<Pod<N>>(options, "pod", N);
+}
+
+static std::vector<size_t> ParseList(const std::string& text)
+{
+    std::vector<size_t> values;
+    size_t start = 0;
+    while (start < text.size())
+    {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos)
+            end = text.size();
+        size_t v = (size_t)strtoull(text.substr(start, end - start).c_str(), nullptr, 10);
+        if (v > 0)
+            values.push_back(v);
+        start = end + 1;
+    }
+    return values;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    size_t hardware = std::thread::hardware_concurrency();
+    if (hardware > 1)
+        options.threads.push_back(hardware);
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto value = [&](const char* name) -> const char* {
+            size_t len = strlen(name);
+            return arg.compare(0, len, name) == 0 ? arg.c_str() + len : nullptr;
+        };
+        if (const char* v = value("--format="))
+            options.json = strcmp(v, "json") == 0;
+        else if (const char* v = value("--filter="))
+            options.filter = v;
+        else if (const char* v = value("--type="))
+            options.type = v;
+        else if (const char* v = value("--max-size="))
+            options.maxSize = (size_t)strtoull(v, nullptr, 10);
+        else if (const char* v = value("--threads="))
+            options.threads = ParseList(v);
+        else if (const char* v = value("--min-time-ms="))
+            options.minTimeMs = atof(v);
+        else if (const char* v = value("--output="))
+            options.output = v;
+        else
+        {
+            fprintf(stderr, "usage: %s [--format=csv|json] [--filter=op] [--type=string|wstring|pod] [--max-size=bytes] "
+                "[--threads=1,2,4] [--min-time-ms=10] [--output=file]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (options.threads.empty())
+        options.threads.push_back(1);
+    if (!options.output.empty() && freopen(options.output.c_str(), "w", stdout) == nullptr)
+    {
+        fprintf(stderr, "cannot write %s\n", options.output.c_str());
+        return 1;
+    }
+
+    if (!options.json)
+        printf("op,type,bytes,threads,iterations,ns_per_op,allocs_per_op,heap_allocs_per_op,crypto_calls_per_op\n");
+    for (size_t bytes = 8; bytes <= options.maxSize && bytes <= (16u << 20); bytes *= 8)
+    {
+        RunType<std::string>(options, "string", bytes);
+        RunType<std::wstring>(options, "wstring", bytes);
+    }
+    RunPod<8>(options);
+    RunPod<64>(options);
+    RunPod<512>(options);
+    RunPod<4096>(options);
+    return 0;
+}
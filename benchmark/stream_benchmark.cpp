@@ -0,0 +1,49 @@
+// Throughput of SecuredPtr::ReadFrom()/WriteTo() and the secure memory in use while a secret is streamed.
+// Only the ciphertext grows with the secret, the clear bytes stay at one chunk of StreamChunkSize.
+// g++ -std=c++17 -O2 -I.. stream_benchmark.cpp -o stream_benchmark
+
+#include "SecuredPtr.h"
+#include <chrono>
+#include <cstdio>
+
+using namespace Secured_Ptr;
+
+int main()
+{
+    typedef SecuredPtr<std::vector<char>> Ptr;
+    printf("%10s %12s %12s %16s %16s\n", "bytes", "read MB/s", "write MB/s", "peak in use", "peak clear");
+    for (size_t size : { 4096, 65536, 1 << 20, 16 << 20 })
+    {
+        std::vector<char> source(size, 's');
+        size_t peakInUse = 0;
+        size_t clear = 0;
+
+        Ptr ptr;
+        size_t offset = 0;
+        auto start = std::chrono::steady_clock::now();
+        ptr.ReadFrom([&](PBYTE buffer, size_t len) -> ptrdiff_t {
+            size_t n = size - offset < len ? size - offset : len;
+            memcpy(buffer, source.data() + offset, n);
+            offset += n;
+            clear = n > clear ? n : clear;
+#ifndef _WIN32
+            size_t inUse = SecureArenaAllocator::GetStats().bytesInUse;
+            peakInUse = inUse > peakInUse ? inUse : peakInUse;
+#endif
+            return (ptrdiff_t)n;
+            }, size);
+        double readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        size_t written = 0;
+        start = std::chrono::steady_clock::now();
+        ptr.WriteTo([&](const BYTE*, size_t len) {
+            written += len;
+            clear = len > clear ? len : clear;
+            return true;
+            });
+        double writeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        printf("%10zu %12.1f %12.1f %16zu %16zu\n", size, size / readSeconds / 1e6, written / writeSeconds / 1e6, peakInUse, clear);
+    }
+    return 0;
+}
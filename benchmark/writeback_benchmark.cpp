@@ -0,0 +1,87 @@
+// Cost of '&' handles on a SecuredPtr<std::string> by what they do with the value: only read it, change it
+// keeping its length, or change its length. Reports ns, secure allocations and crypto calls per handle.
+// g++ -std=c++17 -O2 -I.. writeback_benchmark.cpp -o writeback_benchmark
+
+#include "SecuredPtr.h"
+#include <chrono>
+#include <cstdio>
+
+using namespace Secured_Ptr;
+
+//Default backend counting its calls
+class CountingBackend
+{
+public:
+    static constexpr size_t BlockSize = DefaultCryptBackend::BlockSize;
+    static std::atomic<size_t> calls;
+
+    static constexpr size_t GetBlockSize(size_t dataSize)
+    {
+        return DefaultCryptBackend::GetBlockSize(dataSize);
+    }
+
+    static bool Protect(PBYTE data, size_t dataBlockSize)
+    {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return DefaultCryptBackend::Protect(data, dataBlockSize);
+    }
+
+    static bool Unprotect(PBYTE data, size_t dataBlockSize)
+    {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        return DefaultCryptBackend::Unprotect(data, dataBlockSize);
+    }
+};
+std::atomic<size_t> CountingBackend::calls{ 0 };
+
+//Allocator counting the secure buffers it hands out
+class CountingAllocator
+{
+public:
+    static size_t allocations;
+
+    static PBYTE Allocate(size_t size)
+    {
+        allocations++;
+        return DefaultSecureAllocator::Allocate(size);
+    }
+
+    static void Deallocate(PBYTE ptr, size_t size)
+    {
+        DefaultSecureAllocator::Deallocate(ptr, size);
+    }
+};
+size_t CountingAllocator::allocations = 0;
+
+typedef SecuredPtr<std::string, CountingBackend, CountingAllocator> Secret;
+
+template <typename F>
+static void Run(const char* name, Secret& secret, F&& f)
+{
+    const size_t iterations = 100000;
+    size_t calls = CountingBackend::calls.load();
+    size_t allocations = CountingAllocator::allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        auto handle = &secret;
+        f(*handle, i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    printf("%-18s %10.1f %12.2f %12.2f\n", name,
+        std::chrono::duration<double, std::nano>(elapsed).count() / iterations,
+        (double)(CountingAllocator::allocations - allocations) / iterations,
+        (double)(CountingBackend::calls.load() - calls) / iterations);
+}
+
+int main()
+{
+    volatile size_t sink = 0;
+    Secret secret(std::string(64, 'p'));
+
+    printf("%-18s %10s %12s %12s\n", "handle", "ns/op", "allocs/op", "crypto/op");
+    Run("read only", secret, [&](std::string& value, size_t) { sink += value.size(); });
+    Run("same length", secret, [&](std::string& value, size_t i) { value[0] = (char)('a' + i % 26); });
+    Run("new length", secret, [&](std::string& value, size_t i) { value.resize(64 + i % 2); });
+    return 0;
+}